@@ -81,6 +81,10 @@ typedef struct {
     int status_code;
 } api_response_t;
 
+// Receives a response body piece by piece as it arrives, so bodies of any size pass through
+// without a fixed buffer. Only called for HTTP 200; an error stops further calls.
+typedef esp_err_t (*api_body_callback_t)(const char* data, int len, void* ctx);
+
 esp_err_t api_client_init(void);
 esp_err_t api_client_provision_device(const provisioning_request_t* request, provisioning_response_t* response, api_response_t* api_response);
 esp_err_t api_client_send_heartbeat_v2(const char* device_id, const char* device_token, const heartbeat_data_t* data, heartbeat_response_t* response, api_response_t* api_response);
@@ -88,7 +92,11 @@ esp_err_t api_client_register_device(const char* device_id, const char* token, a
 esp_err_t api_client_send_heartbeat(const char* device_id, const char* token, api_response_t* response);
 esp_err_t api_client_update_status(const char* device_id, const char* token, const char* status, api_response_t* response);
 esp_err_t api_client_get_home_data(const char* device_id, const char* token, home_data_t* home_data, api_response_t* response);
-esp_err_t api_client_check_firmware_update(const char* device_id, const char* token, api_response_t* response);
+esp_err_t api_client_check_firmware_update(const char* device_id, const char* token,
+                                           api_body_callback_t on_body, void* ctx, api_response_t* response);
+
+// Number of API requests currently on the wire (heartbeat, home data, commands, ...)
+int api_client_requests_in_flight(void);
 
 #ifdef __cplusplus
 }
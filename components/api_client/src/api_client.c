@@ -5,10 +5,12 @@
 #include "cJSON.h"
 #include "esp_crt_bundle.h"
 #include <string.h>
+#include <stdatomic.h>
 
 static const char *TAG = "API_CLIENT";
 
 static char response_buffer[MAX_HTTP_RESPONSE_BUFFER];
+static atomic_int s_requests_in_flight = 0;
 
 static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
 {
@@ -50,6 +52,38 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
+typedef struct {
+    api_body_callback_t on_body;
+    void* ctx;
+    esp_err_t err;
+} body_stream_t;
+
+// Hands each piece of a 200 body straight to the caller; chunked bodies arrive de-chunked
+static esp_err_t _stream_event_handler(esp_http_client_event_t *evt)
+{
+    body_stream_t* stream = (body_stream_t*)evt->user_data;
+    
+    if (evt->event_id == HTTP_EVENT_ON_DATA && stream->err == ESP_OK &&
+        esp_http_client_get_status_code(evt->client) == 200) {
+        stream->err = stream->on_body((const char*)evt->data, evt->data_len, stream->ctx);
+    }
+    return ESP_OK;
+}
+
+// Every API call goes through here so background work (OTA) can yield the radio to it
+static esp_err_t perform_request(esp_http_client_handle_t client)
+{
+    atomic_fetch_add(&s_requests_in_flight, 1);
+    esp_err_t err = esp_http_client_perform(client);
+    atomic_fetch_sub(&s_requests_in_flight, 1);
+    return err;
+}
+
+int api_client_requests_in_flight(void)
+{
+    return atomic_load(&s_requests_in_flight);
+}
+
 esp_err_t api_client_init(void)
 {
     ESP_LOGI(TAG, "API client initialized");
@@ -99,7 +133,7 @@ esp_err_t api_client_provision_device(const provisioning_request_t* request, pro
     esp_http_client_set_header(client, "Content-Type", "application/json");
     esp_http_client_set_post_field(client, json_string, strlen(json_string));
     
-    esp_err_t err = esp_http_client_perform(client);
+    esp_err_t err = perform_request(client);
     
     if (err == ESP_OK) {
         int status_code = esp_http_client_get_status_code(client);
@@ -189,7 +223,7 @@ esp_err_t api_client_send_heartbeat_v2(const char* device_id, const char* device
     
     esp_http_client_set_post_field(client, json_string, strlen(json_string));
     
-    esp_err_t err = esp_http_client_perform(client);
+    esp_err_t err = perform_request(client);
     
     if (err == ESP_OK) {
         int status_code = esp_http_client_get_status_code(client);
@@ -330,7 +364,7 @@ esp_err_t api_client_register_device(const char* device_id, const char* token, a
     
     esp_http_client_set_post_field(client, json_string, strlen(json_string));
     
-    esp_err_t err = esp_http_client_perform(client);
+    esp_err_t err = perform_request(client);
     
     if (err == ESP_OK) {
         int status_code = esp_http_client_get_status_code(client);
@@ -358,23 +392,30 @@ esp_err_t api_client_register_device(const char* device_id, const char* token, a
     return err;
 }
 
-esp_err_t api_client_check_firmware_update(const char* device_id, const char* token, api_response_t* response)
+esp_err_t api_client_check_firmware_update(const char* device_id, const char* token,
+                                           api_body_callback_t on_body, void* ctx, api_response_t* response)
 {
-    if (!device_id || !token || !response) {
+    if (!device_id || !token || !on_body || !response) {
         return ESP_ERR_INVALID_ARG;
     }
     
     memset(response, 0, sizeof(api_response_t));
-    memset(response_buffer, 0, sizeof(response_buffer));
     
     char url[256];
     snprintf(url, sizeof(url), "%s/firmware/check/%s", API_BASE_URL, device_id);
     
+    // The manifest grows with every component, so it is streamed instead of copied into data
+    body_stream_t stream = {
+        .on_body = on_body,
+        .ctx = ctx,
+        .err = ESP_OK,
+    };
+    
     esp_http_client_config_t config = {
         .url = url,
         .method = HTTP_METHOD_GET,
-        .event_handler = _http_event_handler,
-        .user_data = response_buffer,
+        .event_handler = _stream_event_handler,
+        .user_data = &stream,
         .timeout_ms = 30000,  // Increase timeout to 30 seconds
         .transport_type = HTTP_TRANSPORT_OVER_SSL,
         .crt_bundle_attach = esp_crt_bundle_attach,
@@ -386,16 +427,19 @@ esp_err_t api_client_check_firmware_update(const char* device_id, const char* to
     snprintf(auth_header, sizeof(auth_header), "Bearer %s", token);
     esp_http_client_set_header(client, "Authorization", auth_header);
     
-    esp_err_t err = esp_http_client_perform(client);
+    esp_err_t err = perform_request(client);
     
     if (err == ESP_OK) {
         int status_code = esp_http_client_get_status_code(client);
         response->status_code = status_code;
         
-        if (status_code == 200) {
+        if (status_code == 200 && stream.err == ESP_OK) {
             response->success = true;
             strncpy(response->message, "Firmware check successful", sizeof(response->message) - 1);
-            strncpy(response->data, response_buffer, sizeof(response->data) - 1);
+        } else if (status_code == 200) {
+            response->success = false;
+            snprintf(response->message, sizeof(response->message), "Manifest rejected: %s", esp_err_to_name(stream.err));
+            err = stream.err;
         } else {
             response->success = false;
             snprintf(response->message, sizeof(response->message), "HTTP error: %d", status_code);
@@ -442,7 +486,7 @@ esp_err_t api_client_get_home_data(const char* device_id, const char* token, hom
     snprintf(auth_header, sizeof(auth_header), "Bearer %s", token);
     esp_http_client_set_header(client, "Authorization", auth_header);
     
-    esp_err_t err = esp_http_client_perform(client);
+    esp_err_t err = perform_request(client);
     
     if (err == ESP_OK) {
         int status_code = esp_http_client_get_status_code(client);
@@ -554,7 +598,7 @@ esp_err_t api_client_send_heartbeat(const char* device_id, const char* token, ap
     
     esp_http_client_set_post_field(client, json_string, strlen(json_string));
     
-    esp_err_t err = esp_http_client_perform(client);
+    esp_err_t err = perform_request(client);
     
     if (err == ESP_OK) {
         int status_code = esp_http_client_get_status_code(client);
@@ -620,7 +664,7 @@ esp_err_t api_client_update_status(const char* device_id, const char* token, con
     
     esp_http_client_set_post_field(client, json_string, strlen(json_string));
     
-    esp_err_t err = esp_http_client_perform(client);
+    esp_err_t err = perform_request(client);
     
     if (err == ESP_OK) {
         int status_code = esp_http_client_get_status_code(client);
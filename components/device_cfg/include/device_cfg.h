@@ -3,6 +3,8 @@
 
 #include "esp_err.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -36,6 +38,32 @@ esp_err_t device_config_save_device_token(const char* token);
 esp_err_t device_config_get_device_token(char* token);
 esp_err_t device_config_factory_reset(void);
 
+// Batched update: the fields set between begin and commit reach flash together or not at
+// all, also across a reset. All writers are serialized: begin blocks while another task has a
+// transaction open or a save in progress, and the other setters block while another task's
+// transaction is open. Every begin must end in commit or abort from the same task.
+esp_err_t device_config_txn_begin(void);
+esp_err_t device_config_txn_set_wifi_credentials(const char* ssid, const char* password);
+esp_err_t device_config_txn_set_auth_token(const char* token);
+esp_err_t device_config_txn_set_provisioning_code(const char* code);
+esp_err_t device_config_txn_set_device_token(const char* token);
+esp_err_t device_config_txn_set_provisioned(bool provisioned);
+esp_err_t device_config_txn_commit(void);
+void device_config_txn_abort(void);
+
+// Zero-copy reads: pointers into the cached config, valid for the life of the program, with the
+// string length in *len (may be NULL). A save can rewrite a field while it is being used;
+// readers that must not act on a torn value bracket the use seqlock-style:
+//   do { v = device_config_read_begin(); ...use views... } while (device_config_read_retry(v));
+const char* device_config_device_id_view(size_t* len);
+const char* device_config_wifi_ssid_view(size_t* len);
+const char* device_config_wifi_password_view(size_t* len);
+const char* device_config_auth_token_view(size_t* len);
+const char* device_config_provisioning_code_view(size_t* len);
+const char* device_config_device_token_view(size_t* len);
+uint32_t device_config_read_begin(void);            // Waits out a save in progress
+bool device_config_read_retry(uint32_t version);    // true = a save overlapped the read
+
 #ifdef __cplusplus
 }
 #endif
@@ -3,14 +3,420 @@
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "utils.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 static const char *TAG = "DEVICE_CFG";
 static const char *NVS_NAMESPACE = "device_config";
 
+// One NVS entry per field, so a setter rewrites only the bytes that changed
+#define KEY_LAYOUT "layout"
+#define KEY_DEVICE_ID "dev_id"
+#define KEY_WIFI_SSID "ssid"
+#define KEY_WIFI_PASSWORD "pass"
+#define KEY_PROVISIONED "prov"
+#define KEY_AUTH_TOKEN "auth_tok"
+#define KEY_PROVISIONING_CODE "prov_code"
+#define KEY_DEVICE_TOKEN "dev_tok"
+#define KEY_LEGACY_BLOB "config"
+#define KEY_TXN_JOURNAL "txn"
+
+#define CONFIG_LAYOUT_PER_KEY 1
+
+// Firmware before the per-key layout kept everything in one "config" blob with this layout.
+// Frozen here so device_config_t can change without breaking the migration.
+typedef struct {
+    char device_id[DEVICE_ID_LENGTH + 1];
+    char wifi_ssid[SSID_MAX_LENGTH + 1];
+    char wifi_password[PASSWORD_MAX_LENGTH + 1];
+    bool is_provisioned;
+    char auth_token[256];
+    char provisioning_code[16];
+    char device_token[512];
+} legacy_config_blob_t;
+
+// Fields a transaction can change, in journal order
+typedef enum {
+    TXN_WIFI_SSID,
+    TXN_WIFI_PASSWORD,
+    TXN_AUTH_TOKEN,
+    TXN_PROVISIONING_CODE,
+    TXN_DEVICE_TOKEN,
+    TXN_PROVISIONED,
+    TXN_FIELD_COUNT
+} txn_field_id_t;
+
+typedef struct {
+    const char* key;
+    size_t offset;              // Into device_config_t
+    size_t size;                // 0 = bool, stored as u8
+} txn_field_t;
+
+#define TXN_STR_FIELD(key, member) { key, offsetof(device_config_t, member), sizeof(((device_config_t*)0)->member) }
+
+static const txn_field_t txn_fields[TXN_FIELD_COUNT] = {
+    [TXN_WIFI_SSID] = TXN_STR_FIELD(KEY_WIFI_SSID, wifi_ssid),
+    [TXN_WIFI_PASSWORD] = TXN_STR_FIELD(KEY_WIFI_PASSWORD, wifi_password),
+    [TXN_AUTH_TOKEN] = TXN_STR_FIELD(KEY_AUTH_TOKEN, auth_token),
+    [TXN_PROVISIONING_CODE] = TXN_STR_FIELD(KEY_PROVISIONING_CODE, provisioning_code),
+    [TXN_DEVICE_TOKEN] = TXN_STR_FIELD(KEY_DEVICE_TOKEN, device_token),
+    [TXN_PROVISIONED] = { KEY_PROVISIONED, offsetof(device_config_t, is_provisioned), 0 },
+};
+
 static device_config_t g_device_config = {0};
 static bool g_initialized = false;
 
+// Odd while g_device_config is being modified; see device_config_read_begin()
+static atomic_uint g_config_version = 0;
+
+// Serializes every writer of the cache and NVS: the setters, factory reset and an open
+// transaction from begin to commit/abort. Recursive, so a setter called by the task that
+// holds a transaction does not deadlock on it.
+static SemaphoreHandle_t g_write_lock = NULL;
+static device_config_t g_txn_pending;      // Only the fields flagged in g_txn_dirty are meaningful
+static uint8_t g_txn_dirty = 0;
+
+static void load_str(nvs_handle_t nvs_handle, const char* key, char* value, size_t size)
+{
+    esp_err_t ret = nvs_get_str(nvs_handle, key, value, &size);
+    if (ret != ESP_OK) {
+        if (ret != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGW(TAG, "Failed to read %s: %s", key, esp_err_to_name(ret));
+        }
+        value[0] = '\0';
+    }
+}
+
+static void load_config(nvs_handle_t nvs_handle)
+{
+    uint8_t provisioned = 0;
+    
+    load_str(nvs_handle, KEY_DEVICE_ID, g_device_config.device_id, sizeof(g_device_config.device_id));
+    load_str(nvs_handle, KEY_WIFI_SSID, g_device_config.wifi_ssid, sizeof(g_device_config.wifi_ssid));
+    load_str(nvs_handle, KEY_WIFI_PASSWORD, g_device_config.wifi_password, sizeof(g_device_config.wifi_password));
+    load_str(nvs_handle, KEY_AUTH_TOKEN, g_device_config.auth_token, sizeof(g_device_config.auth_token));
+    load_str(nvs_handle, KEY_PROVISIONING_CODE, g_device_config.provisioning_code,
+             sizeof(g_device_config.provisioning_code));
+    load_str(nvs_handle, KEY_DEVICE_TOKEN, g_device_config.device_token, sizeof(g_device_config.device_token));
+    nvs_get_u8(nvs_handle, KEY_PROVISIONED, &provisioned);
+    g_device_config.is_provisioned = provisioned != 0;
+}
+
+// Writes every field of g_device_config; used when there is no per-key data yet
+static esp_err_t store_all(nvs_handle_t nvs_handle)
+{
+    esp_err_t ret = nvs_set_str(nvs_handle, KEY_DEVICE_ID, g_device_config.device_id);
+    if (ret == ESP_OK) {
+        ret = nvs_set_str(nvs_handle, KEY_WIFI_SSID, g_device_config.wifi_ssid);
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_set_str(nvs_handle, KEY_WIFI_PASSWORD, g_device_config.wifi_password);
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_set_u8(nvs_handle, KEY_PROVISIONED, g_device_config.is_provisioned ? 1 : 0);
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_set_str(nvs_handle, KEY_AUTH_TOKEN, g_device_config.auth_token);
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_set_str(nvs_handle, KEY_PROVISIONING_CODE, g_device_config.provisioning_code);
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_set_str(nvs_handle, KEY_DEVICE_TOKEN, g_device_config.device_token);
+    }
+    return ret;
+}
+
+static void copy_field(char* dst, size_t size, const char* src)
+{
+    strncpy(dst, src, size - 1);
+    dst[size - 1] = '\0';
+}
+
+static void config_lock(void)
+{
+    xSemaphoreTakeRecursive(g_write_lock, portMAX_DELAY);
+}
+
+static void config_unlock(void)
+{
+    xSemaphoreGiveRecursive(g_write_lock);
+}
+
+// Brackets every change to the cache after init, so zero-copy readers can detect it.
+// Writers hold g_write_lock, so the version never sees two writers at once.
+static void cache_write_begin(void)
+{
+    atomic_fetch_add_explicit(&g_config_version, 1, memory_order_acq_rel);
+}
+
+static void cache_write_end(void)
+{
+    atomic_fetch_add_explicit(&g_config_version, 1, memory_order_release);
+}
+
+// The layout marker is written last and the old blob erased after it, so a reset anywhere
+// in between simply repeats the migration on the next boot
+static esp_err_t migrate_legacy_blob(nvs_handle_t nvs_handle, bool* found)
+{
+    legacy_config_blob_t legacy;
+    size_t size = sizeof(legacy);
+    
+    *found = false;
+    esp_err_t ret = nvs_get_blob(nvs_handle, KEY_LEGACY_BLOB, &legacy, &size);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (ret != ESP_OK || size != sizeof(legacy)) {
+        ESP_LOGW(TAG, "Unreadable legacy config blob (%s, %u bytes) - starting fresh",
+                 esp_err_to_name(ret), (unsigned)size);
+        return ESP_OK;
+    }
+    
+    memset(&g_device_config, 0, sizeof(device_config_t));
+    copy_field(g_device_config.device_id, sizeof(g_device_config.device_id), legacy.device_id);
+    copy_field(g_device_config.wifi_ssid, sizeof(g_device_config.wifi_ssid), legacy.wifi_ssid);
+    copy_field(g_device_config.wifi_password, sizeof(g_device_config.wifi_password), legacy.wifi_password);
+    g_device_config.is_provisioned = legacy.is_provisioned;
+    copy_field(g_device_config.auth_token, sizeof(g_device_config.auth_token), legacy.auth_token);
+    copy_field(g_device_config.provisioning_code, sizeof(g_device_config.provisioning_code),
+               legacy.provisioning_code);
+    copy_field(g_device_config.device_token, sizeof(g_device_config.device_token), legacy.device_token);
+    *found = true;
+    
+    ESP_LOGI(TAG, "Migrating config blob to per-key storage");
+    return ESP_OK;
+}
+
+static esp_err_t open_layout(nvs_handle_t nvs_handle)
+{
+    uint8_t layout = 0;
+    bool migrated = false;
+    
+    if (nvs_get_u8(nvs_handle, KEY_LAYOUT, &layout) == ESP_OK && layout == CONFIG_LAYOUT_PER_KEY) {
+        load_config(nvs_handle);
+        return ESP_OK;
+    }
+    
+    esp_err_t ret = migrate_legacy_blob(nvs_handle, &migrated);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (!migrated) {
+        ESP_LOGI(TAG, "Device config not found, initializing defaults");
+        memset(&g_device_config, 0, sizeof(device_config_t));
+        g_device_config.is_provisioned = false;
+    }
+    if (g_device_config.device_id[0] == '\0') {
+        utils_get_mac_based_device_id(g_device_config.device_id, sizeof(g_device_config.device_id));
+    }
+    
+    ret = store_all(nvs_handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_u8(nvs_handle, KEY_LAYOUT, CONFIG_LAYOUT_PER_KEY);
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    if (ret == ESP_OK && migrated) {
+        nvs_erase_key(nvs_handle, KEY_LEGACY_BLOB);
+        ret = nvs_commit(nvs_handle);
+    }
+    return ret;
+}
+
+// Single-field update: one small NVS entry instead of the whole config
+static esp_err_t store_str(const char* key, const char* value)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    ret = nvs_set_str(nvs_handle, key, value);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    
+    nvs_close(nvs_handle);
+    return ret;
+}
+
+static esp_err_t store_u8(const char* key, uint8_t value)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    ret = nvs_set_u8(nvs_handle, key, value);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    
+    nvs_close(nvs_handle);
+    return ret;
+}
+
+// Updates the NVS key, then the cached field once the value is committed, so the cache never
+// holds a value a reset would lose; an unchanged value costs no flash write
+static esp_err_t update_str(char* field, size_t size, const char* key, const char* value)
+{
+    if (strncmp(field, value, size) == 0) {
+        return ESP_OK;
+    }
+    
+    // Truncated to the field first, so NVS holds exactly what fits the cache on the next boot
+    char* stored = malloc(size);
+    if (!stored) {
+        return ESP_ERR_NO_MEM;
+    }
+    copy_field(stored, size, value);
+    
+    esp_err_t ret = store_str(key, stored);
+    if (ret == ESP_OK) {
+        cache_write_begin();
+        copy_field(field, size, stored);
+        cache_write_end();
+    }
+    free(stored);
+    return ret;
+}
+
+// Journal layout: dirty mask, then each flagged field in txn_fields order - strings with
+// their NUL, the bool as one byte. Bounded by 1 + sizeof(device_config_t).
+static size_t build_journal(uint8_t* journal)
+{
+    size_t len = 0;
+    
+    journal[len++] = g_txn_dirty;
+    for (int i = 0; i < TXN_FIELD_COUNT; i++) {
+        if (!(g_txn_dirty & (1 << i))) {
+            continue;
+        }
+        const uint8_t* value = (const uint8_t*)&g_txn_pending + txn_fields[i].offset;
+        if (txn_fields[i].size == 0) {
+            journal[len++] = *(const bool*)value ? 1 : 0;
+        } else {
+            size_t n = strlen((const char*)value) + 1;
+            memcpy(journal + len, value, n);
+            len += n;
+        }
+    }
+    return len;
+}
+
+// The whole journal is checked before anything is written, so a bad one changes nothing
+static esp_err_t parse_journal(const uint8_t* journal, size_t len, const uint8_t* values[TXN_FIELD_COUNT])
+{
+    if (len < 1 || journal[0] >= (1 << TXN_FIELD_COUNT)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    
+    size_t pos = 1;
+    for (int i = 0; i < TXN_FIELD_COUNT; i++) {
+        values[i] = NULL;
+        if (!(journal[0] & (1 << i))) {
+            continue;
+        }
+        size_t n = txn_fields[i].size == 0 ? 1 : strnlen((const char*)journal + pos, len - pos) + 1;
+        if (pos + n > len || (txn_fields[i].size > 0 && n > txn_fields[i].size)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        values[i] = journal + pos;
+        pos += n;
+    }
+    return pos == len ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+// Writes every journaled field to its own key; the caller commits
+static esp_err_t store_journal(nvs_handle_t nvs_handle, const uint8_t* journal, size_t len)
+{
+    const uint8_t* values[TXN_FIELD_COUNT];
+    esp_err_t ret = parse_journal(journal, len, values);
+    
+    for (int i = 0; i < TXN_FIELD_COUNT && ret == ESP_OK; i++) {
+        if (!values[i]) {
+            continue;
+        }
+        if (txn_fields[i].size == 0) {
+            ret = nvs_set_u8(nvs_handle, txn_fields[i].key, values[i][0]);
+        } else {
+            ret = nvs_set_str(nvs_handle, txn_fields[i].key, (const char*)values[i]);
+        }
+    }
+    return ret;
+}
+
+// Copies a journal that store_journal() accepted and that is committed into the cache
+static void cache_journal(const uint8_t* journal, size_t len)
+{
+    const uint8_t* values[TXN_FIELD_COUNT];
+    if (parse_journal(journal, len, values) != ESP_OK) {
+        return;
+    }
+    
+    for (int i = 0; i < TXN_FIELD_COUNT; i++) {
+        if (!values[i]) {
+            continue;
+        }
+        uint8_t* cached = (uint8_t*)&g_device_config + txn_fields[i].offset;
+        if (txn_fields[i].size == 0) {
+            *(bool*)cached = values[i][0] != 0;
+        } else {
+            copy_field((char*)cached, txn_fields[i].size, (const char*)values[i]);
+        }
+    }
+}
+
+// A journal still present at boot means a reset hit after it was written but before it was
+// erased; applying it again completes the interrupted transaction
+static esp_err_t replay_journal(nvs_handle_t nvs_handle)
+{
+    size_t len = 0;
+    esp_err_t ret = nvs_get_blob(nvs_handle, KEY_TXN_JOURNAL, NULL, &len);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    
+    uint8_t* journal = NULL;
+    if (ret == ESP_OK) {
+        journal = malloc(len > 0 ? len : 1);
+        if (!journal) {
+            return ESP_ERR_NO_MEM;
+        }
+        ret = nvs_get_blob(nvs_handle, KEY_TXN_JOURNAL, journal, &len);
+    }
+    if (ret == ESP_OK) {
+        ESP_LOGW(TAG, "Completing config transaction interrupted by a reset");
+        ret = store_journal(nvs_handle, journal, len);
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    if (ret == ESP_OK) {
+        cache_journal(journal, len);
+    }
+    free(journal);
+    
+    if (ret == ESP_ERR_INVALID_SIZE) {
+        ESP_LOGE(TAG, "Discarding malformed config journal (%u bytes)", (unsigned)len);
+    } else if (ret != ESP_OK) {
+        // Kept for the next boot, which tries again
+        return ret;
+    }
+    
+    nvs_erase_key(nvs_handle, KEY_TXN_JOURNAL);
+    return nvs_commit(nvs_handle);
+}
+
 esp_err_t device_config_init(void)
 {
     if (g_initialized) {
@@ -31,20 +437,23 @@ esp_err_t device_config_init(void)
         return ret;
     }
     
-    size_t required_size = sizeof(device_config_t);
-    ret = nvs_get_blob(nvs_handle, "config", &g_device_config, &required_size);
-    if (ret == ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGI(TAG, "Device config not found, initializing defaults");
-        memset(&g_device_config, 0, sizeof(device_config_t));
-        utils_get_mac_based_device_id(g_device_config.device_id, sizeof(g_device_config.device_id));
-        g_device_config.is_provisioned = false;
-    } else if (ret != ESP_OK) {
+    ret = open_layout(nvs_handle);
+    if (ret == ESP_OK) {
+        ret = replay_journal(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+    if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Error reading device config: %s", esp_err_to_name(ret));
-        nvs_close(nvs_handle);
         return ret;
     }
     
-    nvs_close(nvs_handle);
+    if (!g_write_lock) {
+        g_write_lock = xSemaphoreCreateRecursiveMutex();
+        if (!g_write_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    
     g_initialized = true;
     
     ESP_LOGI(TAG, "Device config initialized. Device ID: %s", g_device_config.device_id);
@@ -71,28 +480,13 @@ esp_err_t device_config_save_wifi_credentials(const char* ssid, const char* pass
         return ESP_ERR_INVALID_ARG;
     }
     
-    strncpy(g_device_config.wifi_ssid, ssid, sizeof(g_device_config.wifi_ssid) - 1);
-    g_device_config.wifi_ssid[sizeof(g_device_config.wifi_ssid) - 1] = '\0';
-    
-    if (password) {
-        strncpy(g_device_config.wifi_password, password, sizeof(g_device_config.wifi_password) - 1);
-        g_device_config.wifi_password[sizeof(g_device_config.wifi_password) - 1] = '\0';
-    } else {
-        g_device_config.wifi_password[0] = '\0';
-    }
-    
-    nvs_handle_t nvs_handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK) {
-        return ret;
-    }
-    
-    ret = nvs_set_blob(nvs_handle, "config", &g_device_config, sizeof(device_config_t));
+    config_lock();
+    esp_err_t ret = update_str(g_device_config.wifi_ssid, sizeof(g_device_config.wifi_ssid), KEY_WIFI_SSID, ssid);
     if (ret == ESP_OK) {
-        ret = nvs_commit(nvs_handle);
+        ret = update_str(g_device_config.wifi_password, sizeof(g_device_config.wifi_password),
+                         KEY_WIFI_PASSWORD, password ? password : "");
     }
-    
-    nvs_close(nvs_handle);
+    config_unlock();
     return ret;
 }
 
@@ -117,30 +511,22 @@ esp_err_t device_config_set_provisioned(bool provisioned)
         return ESP_ERR_INVALID_STATE;
     }
     
-    g_device_config.is_provisioned = provisioned;
-    
-    nvs_handle_t nvs_handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS handle: %s", esp_err_to_name(ret));
-        return ret;
-    }
-    
-    ret = nvs_set_blob(nvs_handle, "config", &g_device_config, sizeof(device_config_t));
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set provisioned blob: %s", esp_err_to_name(ret));
-        nvs_close(nvs_handle);
-        return ret;
+    config_lock();
+    if (g_device_config.is_provisioned == provisioned) {
+        config_unlock();
+        return ESP_OK;
     }
     
-    ret = nvs_commit(nvs_handle);
+    esp_err_t ret = store_u8(KEY_PROVISIONED, provisioned ? 1 : 0);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit NVS: %s", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "Failed to save provisioned flag: %s", esp_err_to_name(ret));
     } else {
+        cache_write_begin();
+        g_device_config.is_provisioned = provisioned;
+        cache_write_end();
         ESP_LOGI(TAG, "Successfully saved provisioned = %s to NVS", provisioned ? "true" : "false");
     }
-    
-    nvs_close(nvs_handle);
+    config_unlock();
     return ret;
 }
 
@@ -162,21 +548,9 @@ esp_err_t device_config_save_auth_token(const char* token)
         return ESP_ERR_INVALID_ARG;
     }
     
-    strncpy(g_device_config.auth_token, token, sizeof(g_device_config.auth_token) - 1);
-    g_device_config.auth_token[sizeof(g_device_config.auth_token) - 1] = '\0';
-    
-    nvs_handle_t nvs_handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK) {
-        return ret;
-    }
-    
-    ret = nvs_set_blob(nvs_handle, "config", &g_device_config, sizeof(device_config_t));
-    if (ret == ESP_OK) {
-        ret = nvs_commit(nvs_handle);
-    }
-    
-    nvs_close(nvs_handle);
+    config_lock();
+    esp_err_t ret = update_str(g_device_config.auth_token, sizeof(g_device_config.auth_token), KEY_AUTH_TOKEN, token);
+    config_unlock();
     return ret;
 }
 
@@ -196,25 +570,34 @@ esp_err_t device_config_factory_reset(void)
         return ESP_ERR_INVALID_STATE;
     }
     
+    config_lock();
     nvs_handle_t nvs_handle;
     esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
     if (ret != ESP_OK) {
+        config_unlock();
         return ret;
     }
     
     ret = nvs_erase_all(nvs_handle);
     if (ret == ESP_OK) {
-        ret = nvs_commit(nvs_handle);
-    }
-    
-    nvs_close(nvs_handle);
-    
-    if (ret == ESP_OK) {
+        cache_write_begin();
         memset(&g_device_config, 0, sizeof(device_config_t));
         utils_get_mac_based_device_id(g_device_config.device_id, sizeof(g_device_config.device_id));
         g_device_config.is_provisioned = false;
+        cache_write_end();
+        
+        // Defaults are written back at once, so setters after the reset land in a valid layout
+        ret = store_all(nvs_handle);
+        if (ret == ESP_OK) {
+            ret = nvs_set_u8(nvs_handle, KEY_LAYOUT, CONFIG_LAYOUT_PER_KEY);
+        }
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
     }
     
+    nvs_close(nvs_handle);
+    config_unlock();
     return ret;
 }
 
@@ -224,21 +607,9 @@ esp_err_t device_config_save_provisioning_code(const char* code)
         return ESP_ERR_INVALID_ARG;
     }
     
-    strncpy(g_device_config.provisioning_code, code, sizeof(g_device_config.provisioning_code) - 1);
-    g_device_config.provisioning_code[sizeof(g_device_config.provisioning_code) - 1] = '\0';
-    
-    nvs_handle_t nvs_handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK) {
-        return ret;
-    }
-    
-    ret = nvs_set_blob(nvs_handle, "config", &g_device_config, sizeof(device_config_t));
-    if (ret == ESP_OK) {
-        ret = nvs_commit(nvs_handle);
-    }
-    
-    nvs_close(nvs_handle);
+    config_lock();
+    esp_err_t ret = update_str(g_device_config.provisioning_code, sizeof(g_device_config.provisioning_code), KEY_PROVISIONING_CODE, code);
+    config_unlock();
     return ret;
 }
 
@@ -258,30 +629,237 @@ esp_err_t device_config_save_device_token(const char* token)
         return ESP_ERR_INVALID_ARG;
     }
     
-    strncpy(g_device_config.device_token, token, sizeof(g_device_config.device_token) - 1);
-    g_device_config.device_token[sizeof(g_device_config.device_token) - 1] = '\0';
+    config_lock();
+    esp_err_t ret = update_str(g_device_config.device_token, sizeof(g_device_config.device_token), KEY_DEVICE_TOKEN, token);
+    config_unlock();
+    return ret;
+}
+
+esp_err_t device_config_get_device_token(char* token)
+{
+    if (!g_initialized || !token) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    strcpy(token, g_device_config.device_token);
+    return ESP_OK;
+}
+
+static bool txn_is_open(void)
+{
+    return g_write_lock && xSemaphoreGetMutexHolder(g_write_lock) == xTaskGetCurrentTaskHandle();
+}
+
+// Flags a field only when it differs from the stored value, so an unchanged field costs nothing
+static void txn_mark(txn_field_id_t id, bool changed)
+{
+    if (changed) {
+        g_txn_dirty |= 1 << id;
+    } else {
+        g_txn_dirty &= ~(1 << id);
+    }
+}
+
+static esp_err_t txn_set_str(txn_field_id_t id, const char* value)
+{
+    if (!txn_is_open()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!value) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    const txn_field_t* field = &txn_fields[id];
+    char* pending = (char*)&g_txn_pending + field->offset;
+    copy_field(pending, field->size, value);
+    txn_mark(id, strcmp(pending, (const char*)&g_device_config + field->offset) != 0);
+    return ESP_OK;
+}
+
+esp_err_t device_config_txn_begin(void)
+{
+    if (!g_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (txn_is_open()) {
+        ESP_LOGE(TAG, "Config transaction already open in this task");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    config_lock();
+    g_txn_dirty = 0;
+    return ESP_OK;
+}
+
+esp_err_t device_config_txn_set_wifi_credentials(const char* ssid, const char* password)
+{
+    esp_err_t ret = txn_set_str(TXN_WIFI_SSID, ssid);
+    if (ret == ESP_OK) {
+        ret = txn_set_str(TXN_WIFI_PASSWORD, password ? password : "");
+    }
+    return ret;
+}
+
+esp_err_t device_config_txn_set_auth_token(const char* token)
+{
+    return txn_set_str(TXN_AUTH_TOKEN, token);
+}
+
+esp_err_t device_config_txn_set_provisioning_code(const char* code)
+{
+    return txn_set_str(TXN_PROVISIONING_CODE, code);
+}
+
+esp_err_t device_config_txn_set_device_token(const char* token)
+{
+    return txn_set_str(TXN_DEVICE_TOKEN, token);
+}
+
+esp_err_t device_config_txn_set_provisioned(bool provisioned)
+{
+    if (!txn_is_open()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    g_txn_pending.is_provisioned = provisioned;
+    txn_mark(TXN_PROVISIONED, provisioned != g_device_config.is_provisioned);
+    return ESP_OK;
+}
+
+// NVS commits are atomic per entry only, so a multi-field change goes through a journal:
+// the journal entry is committed first, then the per-key values, then the journal is erased.
+// A reset before the first commit loses the whole transaction, after it replay_journal()
+// finishes it on the next boot. A single changed field is already atomic and skips the journal.
+static esp_err_t commit_pending(void)
+{
+    uint8_t* journal = malloc(sizeof(device_config_t) + 1);
+    if (!journal) {
+        return ESP_ERR_NO_MEM;
+    }
+    size_t len = build_journal(journal);
+    bool journaled = (g_txn_dirty & (g_txn_dirty - 1)) != 0;
     
     nvs_handle_t nvs_handle;
     esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
     if (ret != ESP_OK) {
+        free(journal);
         return ret;
     }
     
-    ret = nvs_set_blob(nvs_handle, "config", &g_device_config, sizeof(device_config_t));
+    if (journaled) {
+        ret = nvs_set_blob(nvs_handle, KEY_TXN_JOURNAL, journal, len);
+        if (ret == ESP_OK) {
+            ret = nvs_commit(nvs_handle);
+        }
+    }
+    if (ret == ESP_OK) {
+        ret = store_journal(nvs_handle, journal, len);
+    }
     if (ret == ESP_OK) {
         ret = nvs_commit(nvs_handle);
     }
     
+    // Only a committed transaction reaches the cache. A journaled one that failed past its
+    // journal commit is finished by the next boot's replay instead.
+    if (ret == ESP_OK) {
+        cache_write_begin();
+        cache_journal(journal, len);
+        cache_write_end();
+    }
+    if (ret == ESP_OK && journaled) {
+        nvs_erase_key(nvs_handle, KEY_TXN_JOURNAL);
+        ret = nvs_commit(nvs_handle);
+    }
+    
     nvs_close(nvs_handle);
+    free(journal);
     return ret;
 }
 
-esp_err_t device_config_get_device_token(char* token)
+esp_err_t device_config_txn_commit(void)
 {
-    if (!g_initialized || !token) {
-        return ESP_ERR_INVALID_ARG;
+    if (!txn_is_open()) {
+        return ESP_ERR_INVALID_STATE;
     }
     
-    strcpy(token, g_device_config.device_token);
-    return ESP_OK;
+    esp_err_t ret = ESP_OK;
+    if (g_txn_dirty != 0) {
+        ret = commit_pending();
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Config transaction failed: %s", esp_err_to_name(ret));
+        } else {
+            ESP_LOGI(TAG, "Config transaction committed (fields 0x%02x)", g_txn_dirty);
+        }
+    }
+    
+    g_txn_dirty = 0;
+    config_unlock();
+    return ret;
+}
+
+void device_config_txn_abort(void)
+{
+    if (!txn_is_open()) {
+        return;
+    }
+    
+    g_txn_dirty = 0;
+    config_unlock();
+}
+
+uint32_t device_config_read_begin(void)
+{
+    uint32_t version;
+    while ((version = atomic_load_explicit(&g_config_version, memory_order_acquire)) & 1) {
+        vTaskDelay(1);
+    }
+    return version;
+}
+
+bool device_config_read_retry(uint32_t version)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&g_config_version, memory_order_relaxed) != version;
+}
+
+static const char* view_str(const char* field, size_t size, size_t* len)
+{
+    if (!g_initialized) {
+        field = "";
+        size = 1;
+    }
+    if (len) {
+        *len = strnlen(field, size);
+    }
+    return field;
+}
+
+const char* device_config_device_id_view(size_t* len)
+{
+    return view_str(g_device_config.device_id, sizeof(g_device_config.device_id), len);
+}
+
+const char* device_config_wifi_ssid_view(size_t* len)
+{
+    return view_str(g_device_config.wifi_ssid, sizeof(g_device_config.wifi_ssid), len);
+}
+
+const char* device_config_wifi_password_view(size_t* len)
+{
+    return view_str(g_device_config.wifi_password, sizeof(g_device_config.wifi_password), len);
+}
+
+const char* device_config_auth_token_view(size_t* len)
+{
+    return view_str(g_device_config.auth_token, sizeof(g_device_config.auth_token), len);
+}
+
+const char* device_config_provisioning_code_view(size_t* len)
+{
+    return view_str(g_device_config.provisioning_code, sizeof(g_device_config.provisioning_code), len);
+}
+
+const char* device_config_device_token_view(size_t* len)
+{
+    return view_str(g_device_config.device_token, sizeof(g_device_config.device_token), len);
 }
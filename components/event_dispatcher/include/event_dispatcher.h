@@ -0,0 +1,33 @@
+#ifndef EVENT_DISPATCHER_H
+#define EVENT_DISPATCHER_H
+
+#include "esp_err.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EVENT_DISPATCHER_MAX_DATA 320
+
+typedef enum {
+    EVENT_PRIORITY_UI = 0,          // Short display feedback - must never wait behind network work
+    EVENT_PRIORITY_BACKGROUND,      // HTTPS, NVS writes, restarts - large stack, runs in order
+    EVENT_PRIORITY_MAX
+} event_priority_t;
+
+typedef void (*event_dispatcher_handler_t)(void* data);
+
+esp_err_t event_dispatcher_init(void);
+esp_err_t event_dispatcher_deinit(void);
+
+// Copies data (up to EVENT_DISPATCHER_MAX_DATA bytes) and runs handler on the priority's worker.
+// Never blocks, so it is safe from input tasks and system event callbacks.
+esp_err_t event_dispatcher_post(event_priority_t priority, event_dispatcher_handler_t handler,
+                                const void* data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,115 @@
+#include "event_dispatcher.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include <string.h>
+
+static const char *TAG = "EVENT_DISPATCHER";
+
+typedef struct {
+    event_dispatcher_handler_t handler;
+    size_t len;
+    uint8_t data[EVENT_DISPATCHER_MAX_DATA];
+} dispatch_item_t;
+
+typedef struct {
+    const char* name;
+    uint32_t stack_size;
+    UBaseType_t task_priority;
+    UBaseType_t queue_depth;
+} worker_config_t;
+
+// One queue and one worker per level; workers are sized for the work posted at that level
+static const worker_config_t s_worker_config[EVENT_PRIORITY_MAX] = {
+    [EVENT_PRIORITY_UI]         = { "evt_ui",   4096, 6, 4 },
+    [EVENT_PRIORITY_BACKGROUND] = { "evt_bg",   8192, 4, 6 },
+};
+
+static QueueHandle_t s_queues[EVENT_PRIORITY_MAX] = {0};
+static TaskHandle_t s_workers[EVENT_PRIORITY_MAX] = {0};
+static bool s_initialized = false;
+
+static void dispatcher_worker(void* pvParameters)
+{
+    QueueHandle_t queue = (QueueHandle_t)pvParameters;
+    dispatch_item_t item;
+    
+    while (1) {
+        if (xQueueReceive(queue, &item, portMAX_DELAY) == pdTRUE) {
+            item.handler(item.len > 0 ? item.data : NULL);
+        }
+    }
+}
+
+esp_err_t event_dispatcher_init(void)
+{
+    if (s_initialized) {
+        return ESP_OK;
+    }
+    
+    for (int level = 0; level < EVENT_PRIORITY_MAX; level++) {
+        const worker_config_t* cfg = &s_worker_config[level];
+        
+        s_queues[level] = xQueueCreate(cfg->queue_depth, sizeof(dispatch_item_t));
+        if (!s_queues[level]) {
+            ESP_LOGE(TAG, "Failed to create %s queue", cfg->name);
+            event_dispatcher_deinit();
+            return ESP_ERR_NO_MEM;
+        }
+        
+        if (xTaskCreate(dispatcher_worker, cfg->name, cfg->stack_size, s_queues[level],
+                        cfg->task_priority, &s_workers[level]) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create %s worker", cfg->name);
+            event_dispatcher_deinit();
+            return ESP_FAIL;
+        }
+    }
+    
+    s_initialized = true;
+    ESP_LOGI(TAG, "Event dispatcher initialized");
+    return ESP_OK;
+}
+
+esp_err_t event_dispatcher_deinit(void)
+{
+    for (int level = 0; level < EVENT_PRIORITY_MAX; level++) {
+        if (s_workers[level]) {
+            vTaskDelete(s_workers[level]);
+            s_workers[level] = NULL;
+        }
+        if (s_queues[level]) {
+            vQueueDelete(s_queues[level]);
+            s_queues[level] = NULL;
+        }
+    }
+    
+    s_initialized = false;
+    return ESP_OK;
+}
+
+esp_err_t event_dispatcher_post(event_priority_t priority, event_dispatcher_handler_t handler,
+                                const void* data, size_t len)
+{
+    if (priority >= EVENT_PRIORITY_MAX || !handler || len > EVENT_DISPATCHER_MAX_DATA || (len > 0 && !data)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    dispatch_item_t item = {
+        .handler = handler,
+        .len = len,
+    };
+    if (len > 0) {
+        memcpy(item.data, data, len);
+    }
+    
+    if (xQueueSend(s_queues[priority], &item, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "%s queue full, event dropped", s_worker_config[priority].name);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    return ESP_OK;
+}
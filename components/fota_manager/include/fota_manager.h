@@ -4,10 +4,22 @@
 #include <stdbool.h>
 #include "esp_err.h"
 #include "esp_ota_ops.h"
+#include "driver/uart.h"
 
 #define FOTA_VERSION_MAX_LEN 32
 #define FOTA_URL_MAX_LEN 256
 #define FOTA_HASH_MAX_LEN 65
+#define FOTA_TFT_PARTITION_LABEL "tft"
+#define FOTA_SUBBOARD_PARTITION_LABEL "subboard"
+#define FOTA_SUBBOARD_MAX 2
+#define FOTA_SUBBOARD_SLOT_SIZE (64 * 1024)           // Staging space per board in the subboard partition
+#define FOTA_SUBBOARD_NAME_MAX_LEN 12                  // Installed version lives under NVS key "sb_<name>"
+#define FOTA_HEALTH_CHECK_TIMEOUT_MS (10 * 60 * 1000)  // New image must prove itself within this time
+#define FOTA_PROGRESS_MIN_INTERVAL_MS 1000             // Progress events are at least this far apart
+#define FOTA_PROGRESS_MIN_STEP_PERCENT 5               // ... and at least this many percent apart
+#define FOTA_BACKGROUND_TASK_PRIORITY 2                // Below the main loop and the event workers
+#define FOTA_BACKGROUND_DEFAULT_KBPS 48                // Leaves headroom on a slow home uplink
+#define FOTA_INSTALL_POLL_MS (60 * 1000)               // Staged update re-checks the install guard this often
 
 typedef enum {
     FOTA_STATE_IDLE,
@@ -28,13 +40,54 @@ typedef enum {
     FOTA_ERROR_INVALID_FIRMWARE
 } fota_error_t;
 
+typedef enum {
+    FOTA_COMPRESSION_NONE,
+    FOTA_COMPRESSION_ZLIB       // RFC 1950 stream, inflated on the fly with a 32 KB window
+} fota_compression_t;
+
+// An AVR sub-board running Optiboot, programmed over its UART link with STK500v1. The reset
+// pin is driven open-drain; the other boards are held in reset meanwhile so a shared RX line
+// only carries the target's replies.
+typedef struct {
+    const char* name;                   // Matches "board" in the manifest; must outlive the registration
+    uart_port_t uart_num;
+    int tx_pin;
+    int rx_pin;
+    int reset_pin;
+    uint32_t baud_rate;                 // Optiboot: 115200 on Uno-style boards
+    uint16_t page_size;                 // Flash page in bytes (128 on the ATmega328P)
+    uint32_t max_image_size;            // Application flash below the bootloader
+    uint8_t signature[3];
+} fota_subboard_t;
+
+typedef struct {
+    char board[FOTA_SUBBOARD_NAME_MAX_LEN];
+    char version[FOTA_VERSION_MAX_LEN];
+    char url[FOTA_URL_MAX_LEN];
+    char sha256_hash[FOTA_HASH_MAX_LEN];
+    uint32_t size;                      // Raw binary (objcopy -O binary), programmed from address 0
+    bool update_needed;                 // Differs from the version last programmed into the board
+} fota_subboard_image_t;
+
 typedef struct {
     char current_version[FOTA_VERSION_MAX_LEN];
     char available_version[FOTA_VERSION_MAX_LEN];
     char download_url[FOTA_URL_MAX_LEN];
     char sha256_hash[FOTA_HASH_MAX_LEN];
     bool update_available;
-    uint32_t file_size;
+    uint32_t file_size;                 // Size of the installed image (after decompression/patching)
+    fota_compression_t compression;
+    uint32_t compressed_size;           // Bytes served by download_url when compressed
+    char tft_url[FOTA_URL_MAX_LEN];     // Optional NEXTION UI image shipped with this version
+    uint32_t tft_size;
+    char tft_sha256_hash[FOTA_HASH_MAX_LEN];    // Optional; checked after the TFT download when present
+    char delta_url[FOTA_URL_MAX_LEN];   // Optional bsdiff patch; file_size/sha256_hash describe the rebuilt image
+    char delta_base_version[FOTA_VERSION_MAX_LEN];
+    uint32_t delta_size;
+    fota_compression_t delta_compression;
+    fota_subboard_image_t subboards[FOTA_SUBBOARD_MAX];   // Registered boards listed in the manifest
+    uint8_t subboard_count;
+    bool subboard_update_available;     // update_available covers the ESP32 image only
 } fota_info_t;
 
 typedef struct {
@@ -45,8 +98,18 @@ typedef struct {
     uint8_t progress_percent;
 } fota_status_t;
 
+// Runs in the FOTA task with a snapshot of the status, on every state change and on rate-limited
+// progress steps. It must return quickly and must not use the network - post the snapshot on.
 typedef void (*fota_progress_callback_t)(fota_status_t* status);
 
+// Called from the FOTA task once a .tft image has been downloaded to the tft partition
+typedef esp_err_t (*fota_tft_handler_t)(const esp_partition_t* partition, uint32_t size);
+
+// Polled from the FOTA task after a verified download. The panel UI upload, sub-board
+// programming and the boot partition switch all wait until it returns true, so a verified
+// image stays unselected until then. Without a guard the device installs right away.
+typedef bool (*fota_install_guard_t)(void);
+
 esp_err_t fota_manager_init(void);
 esp_err_t fota_manager_deinit(void);
 
@@ -54,10 +117,31 @@ esp_err_t fota_check_for_updates(const char* device_id, const char* auth_token,
 esp_err_t fota_start_update(const char* device_id, const char* auth_token);
 
 esp_err_t fota_set_progress_callback(fota_progress_callback_t callback);
+esp_err_t fota_set_tft_handler(fota_tft_handler_t handler);
+
+esp_err_t fota_set_install_guard(fota_install_guard_t guard);
+
+// Sub-board images are downloaded with the firmware, staged in the subboard partition and
+// programmed once the install guard allows it, before the ESP32 itself restarts
+esp_err_t fota_register_subboard(const fota_subboard_t* board);
+
+// Reboot cost of the last image swap: boot_ms until fota_manager_init ran, ready_ms until the
+// image was confirmed healthy (0 while pending). ESP_ERR_NVS_NOT_FOUND if no swap was measured.
+esp_err_t fota_get_swap_timing(uint32_t* boot_ms, uint32_t* ready_ms);
+
+// Background mode: the update task runs at FOTA_BACKGROUND_TASK_PRIORITY, the download is capped
+// at max_kbytes_per_sec (0 = uncapped) and pauses while any api_client request is in flight.
+// Applies to the next fota_start_update(); ESP_ERR_INVALID_STATE while an update is running.
+esp_err_t fota_set_background_mode(bool enabled, uint32_t max_kbytes_per_sec);
 esp_err_t fota_get_status(fota_status_t* status);
 
+// Boot health check - a freshly installed image boots in PENDING_VERIFY state. The application
+// confirms it with fota_mark_running_partition_valid() once it is healthy (backend reachable);
+// otherwise fota_rollback_if_needed() runs when FOTA_HEALTH_CHECK_TIMEOUT_MS expires and the
+// bootloader returns to the previous image. A crash before confirmation rolls back on its own.
 esp_err_t fota_rollback_if_needed(void);
 esp_err_t fota_mark_running_partition_valid(void);
+bool fota_is_pending_verify(void);
 
 const char* fota_get_current_version(void);
 bool fota_is_running_from_factory(void);
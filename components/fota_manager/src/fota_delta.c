@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "fota_delta.h"
+
+#define TAG "FOTA_DELTA"
+
+#define DELTA_HEADER_LEN (FOTA_DELTA_MAGIC_LEN + 8)
+#define DELTA_CONTROL_LEN 24
+#define DELTA_OLD_BUF_SIZE 4096
+#define DELTA_OUT_BUF_SIZE 4096
+
+typedef enum {
+    DELTA_STATE_HEADER,
+    DELTA_STATE_CONTROL,
+    DELTA_STATE_DIFF,
+    DELTA_STATE_EXTRA,
+    DELTA_STATE_DONE
+} delta_state_t;
+
+struct fota_delta {
+    const esp_partition_t* base;
+    fota_stream_write_t write;
+    void* write_ctx;
+    
+    delta_state_t state;
+    uint8_t field[DELTA_HEADER_LEN];     // Header or control triple being collected
+    size_t field_len;
+    
+    int64_t new_size;
+    int64_t new_pos;
+    int64_t old_pos;
+    int64_t diff_left;
+    int64_t extra_left;
+    int64_t seek;
+    
+    uint8_t old_buf[DELTA_OLD_BUF_SIZE];
+    int64_t old_buf_start;
+    size_t old_buf_len;
+    esp_err_t read_err;
+    
+    uint8_t out_buf[DELTA_OUT_BUF_SIZE];
+    size_t out_len;
+};
+
+// bsdiff's sign-magnitude little-endian 64-bit integer
+static int64_t offtin(const uint8_t* buf)
+{
+    int64_t y = buf[7] & 0x7F;
+    for (int i = 6; i >= 0; i--) {
+        y = y * 256 + buf[i];
+    }
+    return (buf[7] & 0x80) ? -y : y;
+}
+
+static esp_err_t flush_output(fota_delta_t* delta)
+{
+    if (delta->out_len == 0) {
+        return ESP_OK;
+    }
+    esp_err_t ret = delta->write(delta->out_buf, delta->out_len, delta->write_ctx);
+    delta->out_len = 0;
+    return ret;
+}
+
+static esp_err_t emit_byte(fota_delta_t* delta, uint8_t value)
+{
+    delta->out_buf[delta->out_len++] = value;
+    delta->new_pos++;
+    if (delta->out_len == DELTA_OUT_BUF_SIZE) {
+        return flush_output(delta);
+    }
+    return ESP_OK;
+}
+
+// Old image byte at pos, or -1 outside the base partition (bspatch adds nothing there)
+static int old_byte(fota_delta_t* delta, int64_t pos)
+{
+    if (pos < 0 || pos >= delta->base->size) {
+        return -1;
+    }
+    
+    if (pos < delta->old_buf_start || pos >= delta->old_buf_start + (int64_t)delta->old_buf_len) {
+        size_t len = DELTA_OLD_BUF_SIZE;
+        if (pos + (int64_t)len > delta->base->size) {
+            len = delta->base->size - pos;
+        }
+        delta->read_err = esp_partition_read(delta->base, pos, delta->old_buf, len);
+        if (delta->read_err != ESP_OK) {
+            delta->old_buf_len = 0;
+            return -2;
+        }
+        delta->old_buf_start = pos;
+        delta->old_buf_len = len;
+    }
+    return delta->old_buf[pos - delta->old_buf_start];
+}
+
+static esp_err_t parse_header(fota_delta_t* delta)
+{
+    if (memcmp(delta->field, FOTA_DELTA_MAGIC, FOTA_DELTA_MAGIC_LEN) != 0) {
+        ESP_LOGE(TAG, "Not an %s patch", FOTA_DELTA_MAGIC);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    
+    delta->new_size = offtin(delta->field + FOTA_DELTA_MAGIC_LEN);
+    if (delta->new_size <= 0) {
+        ESP_LOGE(TAG, "Invalid target size %lld", (long long)delta->new_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    
+    ESP_LOGI(TAG, "Patch rebuilds a %lld byte image", (long long)delta->new_size);
+    delta->state = DELTA_STATE_CONTROL;
+    return ESP_OK;
+}
+
+static esp_err_t parse_control(fota_delta_t* delta)
+{
+    delta->diff_left = offtin(delta->field);
+    delta->extra_left = offtin(delta->field + 8);
+    delta->seek = offtin(delta->field + 16);
+    
+    if (delta->diff_left < 0 || delta->extra_left < 0 ||
+        delta->new_pos + delta->diff_left + delta->extra_left > delta->new_size) {
+        ESP_LOGE(TAG, "Corrupt control block at output offset %lld", (long long)delta->new_pos);
+        return ESP_ERR_INVALID_CRC;
+    }
+    
+    delta->state = DELTA_STATE_DIFF;
+    return ESP_OK;
+}
+
+// Moves past finished sections; a control block may have empty diff or extra parts
+static esp_err_t advance_state(fota_delta_t* delta)
+{
+    if (delta->state == DELTA_STATE_DIFF && delta->diff_left == 0) {
+        delta->state = DELTA_STATE_EXTRA;
+    }
+    if (delta->state == DELTA_STATE_EXTRA && delta->extra_left == 0) {
+        delta->old_pos += delta->seek;
+        delta->state = (delta->new_pos == delta->new_size) ? DELTA_STATE_DONE : DELTA_STATE_CONTROL;
+    }
+    if (delta->state == DELTA_STATE_DONE) {
+        return flush_output(delta);
+    }
+    return ESP_OK;
+}
+
+esp_err_t fota_delta_begin(const esp_partition_t* base, fota_stream_write_t write, void* ctx, fota_delta_t** out)
+{
+    if (!base || !write || !out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    fota_delta_t* delta = calloc(1, sizeof(fota_delta_t));
+    if (!delta) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    delta->base = base;
+    delta->write = write;
+    delta->write_ctx = ctx;
+    delta->state = DELTA_STATE_HEADER;
+    delta->old_buf_start = -1;
+    
+    *out = delta;
+    return ESP_OK;
+}
+
+esp_err_t fota_delta_feed(fota_delta_t* delta, const uint8_t* data, size_t len)
+{
+    esp_err_t ret = ESP_OK;
+    size_t i = 0;
+    
+    while (i < len && ret == ESP_OK) {
+        switch (delta->state) {
+            case DELTA_STATE_HEADER:
+            case DELTA_STATE_CONTROL: {
+                size_t need = (delta->state == DELTA_STATE_HEADER ? DELTA_HEADER_LEN : DELTA_CONTROL_LEN) - delta->field_len;
+                size_t take = (len - i < need) ? len - i : need;
+                memcpy(delta->field + delta->field_len, data + i, take);
+                delta->field_len += take;
+                i += take;
+                if (take == need) {
+                    delta->field_len = 0;
+                    ret = (delta->state == DELTA_STATE_HEADER) ? parse_header(delta) : parse_control(delta);
+                    if (ret == ESP_OK) {
+                        ret = advance_state(delta);
+                    }
+                }
+                break;
+            }
+            
+            case DELTA_STATE_DIFF:
+                while (i < len && delta->diff_left > 0 && ret == ESP_OK) {
+                    int old = old_byte(delta, delta->old_pos);
+                    if (old == -2) {
+                        ESP_LOGE(TAG, "Base image read at 0x%llx failed", (unsigned long long)delta->old_pos);
+                        ret = delta->read_err;
+                        break;
+                    }
+                    ret = emit_byte(delta, data[i] + (old >= 0 ? old : 0));
+                    delta->old_pos++;
+                    delta->diff_left--;
+                    i++;
+                }
+                if (ret == ESP_OK) {
+                    ret = advance_state(delta);
+                }
+                break;
+            
+            case DELTA_STATE_EXTRA:
+                while (i < len && delta->extra_left > 0 && ret == ESP_OK) {
+                    ret = emit_byte(delta, data[i]);
+                    delta->extra_left--;
+                    i++;
+                }
+                if (ret == ESP_OK) {
+                    ret = advance_state(delta);
+                }
+                break;
+            
+            case DELTA_STATE_DONE:
+                ESP_LOGE(TAG, "%u trailing bytes after the end of the patch", (unsigned)(len - i));
+                return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    
+    return ret;
+}
+
+esp_err_t fota_delta_finish(fota_delta_t* delta, uint32_t* image_size)
+{
+    if (delta->state != DELTA_STATE_DONE) {
+        ESP_LOGE(TAG, "Patch ended early (%lld of %lld bytes rebuilt)",
+                 (long long)delta->new_pos, (long long)delta->new_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    
+    if (image_size) {
+        *image_size = (uint32_t)delta->new_size;
+    }
+    return ESP_OK;
+}
+
+void fota_delta_free(fota_delta_t* delta)
+{
+    free(delta);
+}
@@ -0,0 +1,25 @@
+#ifndef FOTA_DELTA_H
+#define FOTA_DELTA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+// Streaming bspatch for ENDSLEY/BSDIFF43 patches (uncompressed control/diff/extra stream).
+// Patch bytes are fed as they arrive; the rebuilt image is produced through the write callback
+// in order, reading the old image from the base partition. Private to fota_manager.
+
+#define FOTA_DELTA_MAGIC "ENDSLEY/BSDIFF43"
+#define FOTA_DELTA_MAGIC_LEN 16
+
+typedef esp_err_t (*fota_stream_write_t)(const uint8_t* data, size_t len, void* ctx);
+
+typedef struct fota_delta fota_delta_t;
+
+esp_err_t fota_delta_begin(const esp_partition_t* base, fota_stream_write_t write, void* ctx, fota_delta_t** out);
+esp_err_t fota_delta_feed(fota_delta_t* delta, const uint8_t* data, size_t len);
+esp_err_t fota_delta_finish(fota_delta_t* delta, uint32_t* image_size);
+void fota_delta_free(fota_delta_t* delta);
+
+#endif
@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "miniz.h"
+#include "fota_inflate.h"
+
+#define TAG "FOTA_INFLATE"
+
+struct fota_inflate {
+    tinfl_decompressor decomp;
+    fota_stream_write_t write;
+    void* write_ctx;
+    size_t dict_ofs;
+    bool done;
+    uint8_t dict[TINFL_LZ_DICT_SIZE];   // Circular output window; back-references never reach further
+};
+
+esp_err_t fota_inflate_begin(fota_stream_write_t write, void* ctx, fota_inflate_t** out)
+{
+    if (!write || !out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    fota_inflate_t* inflate = malloc(sizeof(fota_inflate_t));
+    if (!inflate) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    tinfl_init(&inflate->decomp);
+    inflate->write = write;
+    inflate->write_ctx = ctx;
+    inflate->dict_ofs = 0;
+    inflate->done = false;
+    
+    *out = inflate;
+    return ESP_OK;
+}
+
+esp_err_t fota_inflate_feed(fota_inflate_t* inflate, const uint8_t* data, size_t len)
+{
+    tinfl_status status;
+    
+    do {
+        if (inflate->done) {
+            ESP_LOGE(TAG, "%u trailing bytes after the end of the zlib stream", (unsigned)len);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        
+        size_t in_bytes = len;
+        size_t out_bytes = TINFL_LZ_DICT_SIZE - inflate->dict_ofs;
+        status = tinfl_decompress(&inflate->decomp, data, &in_bytes,
+                                  inflate->dict, inflate->dict + inflate->dict_ofs, &out_bytes,
+                                  TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+        data += in_bytes;
+        len -= in_bytes;
+        
+        if (out_bytes > 0) {
+            esp_err_t ret = inflate->write(inflate->dict + inflate->dict_ofs, out_bytes, inflate->write_ctx);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            inflate->dict_ofs = (inflate->dict_ofs + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+        
+        if (status < TINFL_STATUS_DONE) {
+            ESP_LOGE(TAG, "Corrupt zlib stream (status %d)", (int)status);
+            return ESP_ERR_INVALID_CRC;
+        }
+        if (status == TINFL_STATUS_DONE) {
+            inflate->done = true;
+        }
+        // HAS_MORE_OUTPUT means the window filled up; drain it even if all input was consumed
+    } while (len > 0 || status == TINFL_STATUS_HAS_MORE_OUTPUT);
+    
+    return ESP_OK;
+}
+
+// The adler32 trailer is checked by tinfl, so DONE means the whole stream arrived intact
+esp_err_t fota_inflate_finish(fota_inflate_t* inflate)
+{
+    if (!inflate->done) {
+        ESP_LOGE(TAG, "zlib stream ended early");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+void fota_inflate_free(fota_inflate_t* inflate)
+{
+    free(inflate);
+}
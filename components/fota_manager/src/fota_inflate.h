@@ -0,0 +1,20 @@
+#ifndef FOTA_INFLATE_H
+#define FOTA_INFLATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "fota_delta.h"
+
+// Streaming zlib (RFC 1950) decoder on the ROM miniz inflater. RAM is fixed at the 32 KB
+// LZ window plus the decompressor state regardless of image size. Output goes through the
+// same callback type as the delta stage so the two can be chained. Private to fota_manager.
+
+typedef struct fota_inflate fota_inflate_t;
+
+esp_err_t fota_inflate_begin(fota_stream_write_t write, void* ctx, fota_inflate_t** out);
+esp_err_t fota_inflate_feed(fota_inflate_t* inflate, const uint8_t* data, size_t len);
+esp_err_t fota_inflate_finish(fota_inflate_t* inflate);
+void fota_inflate_free(fota_inflate_t* inflate);
+
+#endif
@@ -1,31 +1,71 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_http_client.h"
-#include "esp_https_ota.h"
+#include "esp_crt_bundle.h"
 #include "esp_ota_ops.h"
 #include "esp_app_format.h"
 #include "esp_partition.h"
-#include "cJSON.h"
+#include "driver/gpio.h"
+#include "mbedtls/sha256.h"
+#include "nvs.h"
 #include "fota_manager.h"
 #include "api_client.h"
+#include "fota_delta.h"
+#include "fota_inflate.h"
+#include "fota_pipeline.h"
+#include "fota_stk500.h"
+#include "fota_manifest.h"
 
 #define TAG "FOTA_MANAGER"
 #define FOTA_TASK_STACK_SIZE 8192
 #define FOTA_TASK_PRIORITY 5
 #define FOTA_CHECK_INTERVAL_MS (60 * 60 * 1000)
+#define FOTA_DOWNLOAD_BUFFER_SIZE 4096
+#define FOTA_HTTP_RX_BUFFER_SIZE 4096      // esp_http_client default is 512, which splits every TLS record
+#define FOTA_SHA256_LEN 32
+#define FOTA_RESUME_CHECKPOINT_BYTES (64 * 1024)   // Sector aligned; bounds NVS wear to ~40 writes per image
+#define FOTA_RESUME_MIN_BYTES (16 * 1024)          // Not worth a Range request below this
+
+static const char* NVS_NAMESPACE = "fota";
+static const char* NVS_KEY_RESUME = "resume";
+static const char* NVS_KEY_SWAP_AT = "swap_at";        // Wall clock (ms) when the device rebooted into a new image
+static const char* NVS_KEY_SWAP_BOOT = "swap_boot";    // ms from that reboot until fota_manager_init
+static const char* NVS_KEY_SWAP_READY = "swap_ready";  // ms from that reboot until the image was confirmed
+static const char* NVS_KEY_SUBBOARD_PREFIX = "sb_";    // + board name: version last programmed into it
+
+// Where an interrupted plain-image download stopped. Identity is the target SHA-256 plus the
+// partition it was going to; prefix_sha covers image bytes [0, offset) as written to flash.
+typedef struct {
+    char sha256_hash[FOTA_HASH_MAX_LEN];
+    uint32_t partition_address;
+    uint32_t offset;
+    uint8_t prefix_sha[FOTA_SHA256_LEN];
+} fota_resume_point_t;
 
 static fota_status_t g_fota_status = {0};
 static fota_progress_callback_t g_progress_callback = NULL;
+static fota_tft_handler_t g_tft_handler = NULL;
 static TaskHandle_t g_fota_task_handle = NULL;
 static bool g_fota_initialized = false;
 static bool g_fota_update_pending = false;
-
-static const char* FIRMWARE_VERSION = "1.0.0";
+static esp_timer_handle_t g_health_timer = NULL;
+static fota_state_t g_published_state = FOTA_STATE_IDLE;
+static uint8_t g_published_percent = 0;
+static int64_t g_published_us = 0;
+static bool g_background_mode = false;
+static fota_install_guard_t g_install_guard = NULL;
+static fota_subboard_t g_subboards[FOTA_SUBBOARD_MAX];
+static uint8_t g_subboard_count = 0;
+static uint32_t g_background_rate_bps = FOTA_BACKGROUND_DEFAULT_KBPS * 1024;
+static const esp_partition_t* g_staged_partition = NULL;  // Verified, not yet selected for boot
 
 static esp_err_t validate_firmware_image(const esp_partition_t* update_partition)
 {
@@ -34,7 +74,7 @@ static esp_err_t validate_firmware_image(const esp_partition_t* update_partition
         ESP_LOGI(TAG, "New firmware version: %s", new_app_info.version);
         
         const esp_app_desc_t* running_app_info = esp_app_get_description();
-        if (strcmp(new_app_info.version, running_app_info->version) > 0) {
+        if (fota_version_compare(new_app_info.version, running_app_info->version) > 0) {
             ESP_LOGI(TAG, "Firmware validation passed");
             return ESP_OK;
         } else {
@@ -45,121 +85,861 @@ static esp_err_t validate_firmware_image(const esp_partition_t* update_partition
     return ESP_FAIL;
 }
 
+// Listeners get a snapshot on every state change, and otherwise only when progress moved by
+// FOTA_PROGRESS_MIN_STEP_PERCENT and FOTA_PROGRESS_MIN_INTERVAL_MS passed - not per received block
+static void publish_status(bool force)
+{
+    if (!g_progress_callback) {
+        return;
+    }
+    
+    int64_t now_us = esp_timer_get_time();
+    if (!force && g_fota_status.progress_percent != 100) {
+        int step = abs((int)g_fota_status.progress_percent - (int)g_published_percent);
+        if (step < FOTA_PROGRESS_MIN_STEP_PERCENT ||
+            now_us - g_published_us < FOTA_PROGRESS_MIN_INTERVAL_MS * 1000LL) {
+            return;
+        }
+    }
+    
+    g_published_state = g_fota_status.state;
+    g_published_percent = g_fota_status.progress_percent;
+    g_published_us = now_us;
+    
+    fota_status_t snapshot = g_fota_status;
+    g_progress_callback(&snapshot);
+}
+
+static void set_state(fota_state_t state)
+{
+    g_fota_status.state = state;
+    publish_status(state != g_published_state);
+}
+
 static void update_progress(uint32_t bytes_downloaded, uint32_t total_bytes)
 {
     g_fota_status.bytes_downloaded = bytes_downloaded;
     g_fota_status.total_bytes = total_bytes;
     
     if (total_bytes > 0) {
-        g_fota_status.progress_percent = (bytes_downloaded * 100) / total_bytes;
+        g_fota_status.progress_percent = (uint8_t)((uint64_t)bytes_downloaded * 100 / total_bytes);
+    }
+    
+    publish_status(false);
+}
+
+static int hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static esp_err_t parse_sha256_hex(const char* hex, uint8_t out[FOTA_SHA256_LEN])
+{
+    if (!hex || strlen(hex) != FOTA_SHA256_LEN * 2) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    for (int i = 0; i < FOTA_SHA256_LEN; i++) {
+        int hi = hex_nibble(hex[i * 2]);
+        int lo = hex_nibble(hex[i * 2 + 1]);
+        if (hi < 0 || lo < 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        out[i] = (hi << 4) | lo;
+    }
+    return ESP_OK;
+}
+
+static bool foreground_request_active(void)
+{
+    return api_client_requests_in_flight() > 0;
+}
+
+// Every download in background mode is shaped the same way, firmware and raw images alike
+static const fota_pipeline_throttle_t* background_throttle(fota_pipeline_throttle_t* throttle)
+{
+    if (!g_background_mode) {
+        return NULL;
+    }
+    throttle->max_bytes_per_sec = g_background_rate_bps;
+    throttle->should_pause = foreground_request_active;
+    return throttle;
+}
+
+typedef struct {
+    esp_ota_handle_t ota_handle;
+    mbedtls_sha256_context sha_ctx;
+    uint32_t written;
+    uint32_t image_size;
+    fota_resume_point_t* resume;        // Non-NULL when checkpoints are recorded
+} image_sink_t;
+
+static void save_resume_point(const fota_resume_point_t* point)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(nvs_handle, NVS_KEY_RESUME, point, sizeof(fota_resume_point_t)) == ESP_OK) {
+        nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+}
+
+static void clear_resume_point(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_erase_key(nvs_handle, NVS_KEY_RESUME) == ESP_OK) {
+        nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+}
+
+// Returns the offset to resume from with sha_ctx holding the hash of everything before it, or 0.
+// The flash prefix is re-hashed and must match the digest taken when the checkpoint was written,
+// so a partition touched in between (or a torn write) restarts from byte 0 instead of corrupting.
+static uint32_t load_resume_point(const fota_info_t* info, const esp_partition_t* partition,
+                                  mbedtls_sha256_context* sha_ctx, fota_resume_point_t* point)
+{
+    nvs_handle_t nvs_handle;
+    size_t size = sizeof(fota_resume_point_t);
+    
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return 0;
+    }
+    esp_err_t ret = nvs_get_blob(nvs_handle, NVS_KEY_RESUME, point, &size);
+    nvs_close(nvs_handle);
+    
+    if (ret != ESP_OK || size != sizeof(fota_resume_point_t) ||
+        strcmp(point->sha256_hash, info->sha256_hash) != 0 ||
+        point->partition_address != partition->address ||
+        point->offset < FOTA_RESUME_MIN_BYTES || point->offset >= info->file_size ||
+        point->offset % FOTA_RESUME_CHECKPOINT_BYTES != 0) {
+        return 0;
     }
     
-    if (g_progress_callback) {
-        g_progress_callback(&g_fota_status);
+    uint8_t* block = malloc(FOTA_DOWNLOAD_BUFFER_SIZE);
+    if (!block) {
+        return 0;
     }
+    
+    for (uint32_t pos = 0; pos < point->offset && ret == ESP_OK; pos += FOTA_DOWNLOAD_BUFFER_SIZE) {
+        ret = esp_partition_read(partition, pos, block, FOTA_DOWNLOAD_BUFFER_SIZE);
+        if (ret == ESP_OK) {
+            mbedtls_sha256_update(sha_ctx, block, FOTA_DOWNLOAD_BUFFER_SIZE);
+        }
+    }
+    free(block);
+    
+    mbedtls_sha256_context prefix_ctx;
+    uint8_t prefix_sha[FOTA_SHA256_LEN];
+    mbedtls_sha256_init(&prefix_ctx);
+    mbedtls_sha256_clone(&prefix_ctx, sha_ctx);
+    mbedtls_sha256_finish(&prefix_ctx, prefix_sha);
+    mbedtls_sha256_free(&prefix_ctx);
+    
+    if (ret != ESP_OK || memcmp(prefix_sha, point->prefix_sha, FOTA_SHA256_LEN) != 0) {
+        ESP_LOGW(TAG, "Partial image no longer matches its checkpoint - restarting download");
+        mbedtls_sha256_starts(sha_ctx, 0);
+        return 0;
+    }
+    
+    return point->offset;
 }
 
-static esp_err_t download_and_install_firmware(const char* download_url)
+// Called with the hash state exactly at a checkpoint boundary
+static void record_checkpoint(image_sink_t* sink)
+{
+    mbedtls_sha256_context prefix_ctx;
+    mbedtls_sha256_init(&prefix_ctx);
+    mbedtls_sha256_clone(&prefix_ctx, &sink->sha_ctx);
+    mbedtls_sha256_finish(&prefix_ctx, sink->resume->prefix_sha);
+    mbedtls_sha256_free(&prefix_ctx);
+    
+    sink->resume->offset = sink->written;
+    save_resume_point(sink->resume);
+}
+
+// Every byte of the new image passes through here, whether downloaded as-is or rebuilt from a patch
+static esp_err_t image_sink_write(const uint8_t* data, size_t len, void* ctx)
+{
+    image_sink_t* sink = (image_sink_t*)ctx;
+    
+    if (sink->written + len > sink->image_size) {
+        ESP_LOGE(TAG, "Image is larger than the announced %lu bytes", (unsigned long)sink->image_size);
+        g_fota_status.last_error = FOTA_ERROR_INVALID_FIRMWARE;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    
+    while (len > 0) {
+        // Split writes at checkpoint boundaries so the hash state there can be captured
+        size_t n = len;
+        if (sink->resume) {
+            size_t to_boundary = FOTA_RESUME_CHECKPOINT_BYTES - (sink->written % FOTA_RESUME_CHECKPOINT_BYTES);
+            n = (len < to_boundary) ? len : to_boundary;
+        }
+        
+        mbedtls_sha256_update(&sink->sha_ctx, data, n);
+        
+        esp_err_t ret = esp_ota_write(sink->ota_handle, data, n);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "esp_ota_write failed: %s", esp_err_to_name(ret));
+            g_fota_status.last_error = FOTA_ERROR_FLASH;
+            return ret;
+        }
+        
+        sink->written += n;
+        data += n;
+        len -= n;
+        
+        if (sink->resume && sink->written % FOTA_RESUME_CHECKPOINT_BYTES == 0) {
+            record_checkpoint(sink);
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t delta_stage_write(const uint8_t* data, size_t len, void* ctx)
+{
+    return fota_delta_feed((fota_delta_t*)ctx, data, len);
+}
+
+static esp_err_t inflate_stage_write(const uint8_t* data, size_t len, void* ctx)
+{
+    return fota_inflate_feed((fota_inflate_t*)ctx, data, len);
+}
+
+// Hashes each chunk as it is received (hardware SHA engine via mbedtls) before it goes to flash,
+// so the image is checked without reading the partition back, and rejected before esp_ota_end().
+// With use_delta the download is a bsdiff patch against the running image; the rebuilt output
+// is hashed, so info->sha256_hash and info->file_size always describe the full image.
+// Either download may be zlib-compressed; it is inflated in a fixed 32 KB window before that.
+// Plain full images are resumable: checkpoints go to NVS and the next attempt continues with
+// an HTTP Range request. Decoder state for compressed or delta streams cannot be persisted,
+// so those always start over.
+static esp_err_t install_firmware(const fota_info_t* info, bool use_delta)
 {
     esp_err_t ret = ESP_OK;
-    esp_https_ota_handle_t ota_handle = 0;
     const esp_partition_t* update_partition = NULL;
+    esp_http_client_handle_t client = NULL;
+    fota_delta_t* delta = NULL;
+    fota_inflate_t* inflate = NULL;
+    image_sink_t sink = { .image_size = info->file_size };
+    uint8_t expected_sha[FOTA_SHA256_LEN];
+    uint8_t actual_sha[FOTA_SHA256_LEN];
+    fota_resume_point_t resume_point = {0};
+    uint32_t resume_offset = 0;
+    
+    const char* url = use_delta ? info->delta_url : info->download_url;
+    fota_compression_t compression = use_delta ? info->delta_compression : info->compression;
+    uint32_t transfer_size = use_delta ? info->delta_size :
+                             (compression == FOTA_COMPRESSION_NONE ? info->file_size : info->compressed_size);
+    
+    ESP_LOGI(TAG, "Starting %s%s OTA update from: %s", use_delta ? "delta" : "full",
+             compression == FOTA_COMPRESSION_ZLIB ? " (zlib)" : "", url);
+    
+    if (parse_sha256_hex(info->sha256_hash, expected_sha) != ESP_OK) {
+        ESP_LOGE(TAG, "Manifest sha256 is not a 64 digit hex string");
+        set_state(FOTA_STATE_ERROR);
+        g_fota_status.last_error = FOTA_ERROR_VERIFICATION;
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    set_state(FOTA_STATE_DOWNLOADING);
+    update_progress(0, transfer_size);
+    
+    update_partition = esp_ota_get_next_update_partition(NULL);
+    if (update_partition == NULL) {
+        ESP_LOGE(TAG, "No OTA partition found");
+        set_state(FOTA_STATE_ERROR);
+        g_fota_status.last_error = FOTA_ERROR_FLASH;
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    ESP_LOGI(TAG, "Writing to partition subtype %d at offset 0x%lx",
+             update_partition->subtype, (unsigned long)update_partition->address);
     
-    ESP_LOGI(TAG, "Starting OTA update from: %s", download_url);
+    mbedtls_sha256_init(&sink.sha_ctx);
+    mbedtls_sha256_starts(&sink.sha_ctx, 0);
     
-    g_fota_status.state = FOTA_STATE_DOWNLOADING;
-    update_progress(0, 0);
+    bool resumable = !use_delta && compression == FOTA_COMPRESSION_NONE;
+    if (resumable) {
+        resume_offset = load_resume_point(info, update_partition, &sink.sha_ctx, &resume_point);
+        strncpy(resume_point.sha256_hash, info->sha256_hash, FOTA_HASH_MAX_LEN - 1);
+        resume_point.partition_address = update_partition->address;
+        sink.resume = &resume_point;
+    }
+    
+    // Download -> [inflate] -> [bspatch] -> SHA-256 + flash
+    fota_stream_write_t feed = image_sink_write;
+    void* feed_ctx = &sink;
+    if (use_delta) {
+        ret = fota_delta_begin(esp_ota_get_running_partition(), feed, feed_ctx, &delta);
+        feed = delta_stage_write;
+        feed_ctx = delta;
+    }
+    if (ret == ESP_OK && compression == FOTA_COMPRESSION_ZLIB) {
+        ret = fota_inflate_begin(feed, feed_ctx, &inflate);
+        feed = inflate_stage_write;
+        feed_ctx = inflate;
+    }
+    if (ret != ESP_OK) {
+        fota_delta_free(delta);
+        mbedtls_sha256_free(&sink.sha_ctx);
+        set_state(FOTA_STATE_ERROR);
+        return ret;
+    }
     
     esp_http_client_config_t config = {
-        .url = download_url,
+        .url = url,
         .timeout_ms = 30000,
+        .buffer_size = FOTA_HTTP_RX_BUFFER_SIZE,
         .keep_alive_enable = true,
+        .crt_bundle_attach = esp_crt_bundle_attach,
     };
     
-    esp_https_ota_config_t ota_config = {
-        .http_config = &config,
-    };
+    client = esp_http_client_init(&config);
+    if (!client) {
+        fota_inflate_free(inflate);
+        fota_delta_free(delta);
+        mbedtls_sha256_free(&sink.sha_ctx);
+        set_state(FOTA_STATE_ERROR);
+        g_fota_status.last_error = FOTA_ERROR_NETWORK;
+        return ESP_FAIL;
+    }
+    
+    if (resume_offset > 0) {
+        char range[32];
+        snprintf(range, sizeof(range), "bytes=%lu-", (unsigned long)resume_offset);
+        esp_http_client_set_header(client, "Range", range);
+    }
     
-    ret = esp_https_ota_begin(&ota_config, &ota_handle);
+    ret = esp_http_client_open(client, 0);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "esp_https_ota_begin failed: %s", esp_err_to_name(ret));
-        g_fota_status.state = FOTA_STATE_ERROR;
+        ESP_LOGE(TAG, "HTTP open failed: %s", esp_err_to_name(ret));
         g_fota_status.last_error = FOTA_ERROR_NETWORK;
-        return ret;
+        goto cleanup;
     }
     
-    update_partition = esp_ota_get_next_update_partition(NULL);
-    if (update_partition == NULL) {
-        ESP_LOGE(TAG, "No OTA partition found");
-        esp_https_ota_abort(ota_handle);
-        g_fota_status.state = FOTA_STATE_ERROR;
+    int64_t content_length = esp_http_client_fetch_headers(client);
+    int status = esp_http_client_get_status_code(client);
+    if (resume_offset > 0 && status == 200) {
+        // Server ignored the Range header and is sending the whole image
+        ESP_LOGW(TAG, "Range not honoured - restarting download from byte 0");
+        resume_offset = 0;
+        mbedtls_sha256_starts(&sink.sha_ctx, 0);
+    } else if (status != (resume_offset > 0 ? 206 : 200)) {
+        ESP_LOGE(TAG, "Firmware download returned HTTP %d", status);
+        g_fota_status.last_error = FOTA_ERROR_SERVER;
+        ret = ESP_FAIL;
+        goto cleanup;
+    }
+    
+    if (resume_offset > 0) {
+        // Keeps the verified prefix; sectors from the checkpoint on are erased as they are written
+        ret = esp_ota_resume(update_partition, OTA_WITH_SEQUENTIAL_WRITES, resume_offset, &sink.ota_handle);
+        ESP_LOGI(TAG, "Resuming download at %lu of %lu bytes",
+                 (unsigned long)resume_offset, (unsigned long)info->file_size);
+    } else {
+        ret = esp_ota_begin(update_partition, info->file_size, &sink.ota_handle);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open OTA partition: %s", esp_err_to_name(ret));
         g_fota_status.last_error = FOTA_ERROR_FLASH;
-        return ESP_ERR_NOT_FOUND;
+        sink.ota_handle = 0;
+        goto cleanup;
     }
     
-    ESP_LOGI(TAG, "Writing to partition subtype %d at offset 0x%x",
-             update_partition->subtype, update_partition->address);
+    // A chunked response has no length; otherwise the server must agree with the manifest
+    if (content_length > 0 && content_length != (int64_t)(transfer_size - resume_offset)) {
+        ESP_LOGE(TAG, "Server sends %lld bytes, manifest expects %lu",
+                 (long long)content_length, (unsigned long)(transfer_size - resume_offset));
+        g_fota_status.last_error = FOTA_ERROR_SERVER;
+        ret = ESP_ERR_INVALID_SIZE;
+        goto cleanup;
+    }
     
-    int total_size = esp_https_ota_get_image_len_read(ota_handle);
-    int downloaded = 0;
+    sink.written = resume_offset;
+    update_progress(resume_offset, transfer_size);
     
-    while (1) {
-        ret = esp_https_ota_perform(ota_handle);
-        if (ret != ESP_ERR_HTTPS_OTA_IN_PROGRESS) {
-            break;
-        }
-        
-        downloaded = esp_https_ota_get_image_len_read(ota_handle);
-        if (total_size == 0) {
-            total_size = downloaded + 100000; // Estimate if size unknown
-        }
-        update_progress(downloaded, total_size);
-        
-        ESP_LOGI(TAG, "Downloaded %d of %d bytes", downloaded, total_size);
-        vTaskDelay(pdMS_TO_TICKS(100));
+    fota_pipeline_stats_t stats;
+    fota_pipeline_throttle_t throttle;
+    ret = fota_pipeline_run(client, resume_offset, transfer_size, feed, feed_ctx,
+                            background_throttle(&throttle), update_progress, &stats);
+    uint32_t downloaded = stats.received;
+    if (ret != ESP_OK && g_fota_status.last_error == FOTA_ERROR_NONE) {
+        g_fota_status.last_error = stats.read_failed ? FOTA_ERROR_NETWORK : FOTA_ERROR_INVALID_FIRMWARE;
     }
     
+    // Only a complete stream flushes its tail into the image
+    if (ret == ESP_OK && inflate) {
+        ret = fota_inflate_finish(inflate);
+    }
+    if (ret == ESP_OK && delta) {
+        ret = fota_delta_finish(delta, NULL);
+    }
+    if (ret != ESP_OK && g_fota_status.last_error == FOTA_ERROR_NONE) {
+        g_fota_status.last_error = FOTA_ERROR_INVALID_FIRMWARE;
+    }
+    
+    mbedtls_sha256_finish(&sink.sha_ctx, actual_sha);
+    mbedtls_sha256_free(&sink.sha_ctx);
+    
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "esp_https_ota_perform failed: %s", esp_err_to_name(ret));
-        g_fota_status.state = FOTA_STATE_ERROR;
+        goto cleanup;
+    }
+    
+    set_state(FOTA_STATE_VERIFYING);
+    
+    if (downloaded != transfer_size || sink.written != info->file_size) {
+        ESP_LOGE(TAG, "Download incomplete: %lu of %lu bytes, image %lu of %lu bytes",
+                 (unsigned long)downloaded, (unsigned long)transfer_size,
+                 (unsigned long)sink.written, (unsigned long)info->file_size);
         g_fota_status.last_error = FOTA_ERROR_NETWORK;
+        ret = ESP_ERR_INVALID_SIZE;
+        goto cleanup;
+    }
+    
+    if (memcmp(actual_sha, expected_sha, FOTA_SHA256_LEN) != 0) {
+        ESP_LOGE(TAG, "SHA-256 mismatch - image rejected");
+        clear_resume_point();
+        g_fota_status.last_error = FOTA_ERROR_VERIFICATION;
+        ret = ESP_ERR_INVALID_CRC;
         goto cleanup;
     }
     
-    g_fota_status.state = FOTA_STATE_VERIFYING;
+    ESP_LOGI(TAG, "SHA-256 verified over %lu bytes", (unsigned long)sink.written);
     
     if (validate_firmware_image(update_partition) != ESP_OK) {
         ESP_LOGE(TAG, "Firmware validation failed");
-        g_fota_status.state = FOTA_STATE_ERROR;
+        clear_resume_point();
         g_fota_status.last_error = FOTA_ERROR_VERIFICATION;
         ret = ESP_ERR_INVALID_VERSION;
         goto cleanup;
     }
     
-    g_fota_status.state = FOTA_STATE_INSTALLING;
+    set_state(FOTA_STATE_INSTALLING);
     
-    ret = esp_https_ota_finish(ota_handle);
+    // The boot partition is only switched inside the install window, so a reset while the
+    // update waits for it still comes back up on the running image
+    ret = esp_ota_end(sink.ota_handle);
+    sink.ota_handle = 0;
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "esp_https_ota_finish failed: %s", esp_err_to_name(ret));
-        g_fota_status.state = FOTA_STATE_ERROR;
+        ESP_LOGE(TAG, "Failed to finalize OTA image: %s", esp_err_to_name(ret));
         g_fota_status.last_error = FOTA_ERROR_FLASH;
-        return ret;
+        goto cleanup;
     }
     
-    g_fota_status.state = FOTA_STATE_COMPLETE;
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    fota_inflate_free(inflate);
+    fota_delta_free(delta);
+    if (resumable) {
+        clear_resume_point();
+    }
+    
+    g_staged_partition = update_partition;
     g_fota_status.progress_percent = 100;
     g_fota_update_pending = true;
+    set_state(FOTA_STATE_COMPLETE);
     
-    ESP_LOGI(TAG, "OTA update completed successfully. Update will be applied on next restart.");
+    ESP_LOGI(TAG, "OTA update completed successfully (%lu bytes in %lu ms). Staged for the install window.",
+             (unsigned long)(downloaded - resume_offset), (unsigned long)stats.elapsed_ms);
     return ESP_OK;
 
 cleanup:
-    if (ota_handle) {
-        esp_https_ota_abort(ota_handle);
+    if (sink.ota_handle) {
+        esp_ota_abort(sink.ota_handle);
+    }
+    mbedtls_sha256_free(&sink.sha_ctx);
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    fota_inflate_free(inflate);
+    fota_delta_free(delta);
+    set_state(FOTA_STATE_ERROR);
+    return ret;
+}
+
+// A patch only applies to the exact image it was built against
+static bool delta_applicable(const fota_info_t* info)
+{
+    if (info->delta_url[0] == '\0' || info->delta_size == 0) {
+        return false;
+    }
+    if (fota_version_compare(info->delta_base_version, fota_get_current_version()) != 0) {
+        ESP_LOGI(TAG, "Delta is based on %s, running %s - using full image",
+                 info->delta_base_version, fota_get_current_version());
+        return false;
+    }
+    return true;
+}
+
+static esp_err_t download_and_install_firmware(const fota_info_t* info)
+{
+    if (delta_applicable(info)) {
+        esp_err_t ret = install_firmware(info, true);
+        if (ret == ESP_OK) {
+            return ESP_OK;
+        }
+        ESP_LOGW(TAG, "Delta update failed (%s), falling back to full image", esp_err_to_name(ret));
+        g_fota_status.last_error = FOTA_ERROR_NONE;
+    }
+    
+    return install_firmware(info, false);
+}
+
+typedef struct {
+    const esp_partition_t* partition;
+    uint32_t offset;
+    uint32_t written;
+    mbedtls_sha256_context sha_ctx;
+} raw_sink_t;
+
+static esp_err_t raw_sink_write(const uint8_t* data, size_t len, void* ctx)
+{
+    raw_sink_t* sink = (raw_sink_t*)ctx;
+    
+    mbedtls_sha256_update(&sink->sha_ctx, data, len);
+    esp_err_t ret = esp_partition_write(sink->partition, sink->offset + sink->written, data, len);
+    if (ret == ESP_OK) {
+        sink->written += len;
     }
     return ret;
 }
 
+// Non-app images (panel UI, sub-board firmware) go to plain data partitions with raw partition
+// writes, through the same pipeline and background shaping as the firmware image. With
+// sha256_hex the image is hashed on the way in and rejected on mismatch.
+static esp_err_t download_raw_image(const char* url, const esp_partition_t* partition, uint32_t offset,
+                                    uint32_t size, const char* sha256_hex)
+{
+    uint8_t expected_sha[FOTA_SHA256_LEN];
+    if (sha256_hex && parse_sha256_hex(sha256_hex, expected_sha) != ESP_OK) {
+        ESP_LOGE(TAG, "Invalid SHA-256 for %s", url);
+        g_fota_status.last_error = FOTA_ERROR_SERVER;
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    ESP_LOGI(TAG, "Downloading %s to '%s' at 0x%lx", url, partition->label, (unsigned long)offset);
+    set_state(FOTA_STATE_DOWNLOADING);
+    update_progress(0, size);
+    
+    uint32_t erase_size = (size + 4095) & ~4095;
+    esp_err_t ret = esp_partition_erase_range(partition, offset, erase_size);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to erase '%s': %s", partition->label, esp_err_to_name(ret));
+        return ret;
+    }
+    
+    esp_http_client_config_t config = {
+        .url = url,
+        .timeout_ms = 30000,
+        .buffer_size = FOTA_HTTP_RX_BUFFER_SIZE,
+        .keep_alive_enable = true,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (!client) {
+        return ESP_FAIL;
+    }
+    
+    raw_sink_t sink = {
+        .partition = partition,
+        .offset = offset,
+    };
+    mbedtls_sha256_init(&sink.sha_ctx);
+    mbedtls_sha256_starts(&sink.sha_ctx, 0);
+    
+    ret = esp_http_client_open(client, 0);
+    if (ret == ESP_OK) {
+        esp_http_client_fetch_headers(client);
+        int status = esp_http_client_get_status_code(client);
+        if (status != 200) {
+            ESP_LOGE(TAG, "Image download returned HTTP %d", status);
+            ret = ESP_FAIL;
+        }
+    }
+    
+    if (ret == ESP_OK) {
+        fota_pipeline_stats_t stats;
+        fota_pipeline_throttle_t throttle;
+        ret = fota_pipeline_run(client, 0, size, raw_sink_write, &sink,
+                                background_throttle(&throttle), update_progress, &stats);
+    }
+    
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    
+    uint8_t actual_sha[FOTA_SHA256_LEN];
+    mbedtls_sha256_finish(&sink.sha_ctx, actual_sha);
+    mbedtls_sha256_free(&sink.sha_ctx);
+    
+    if (ret == ESP_OK && sink.written != size) {
+        ESP_LOGE(TAG, "Download incomplete: %lu of %lu bytes", (unsigned long)sink.written, (unsigned long)size);
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    if (ret != ESP_OK) {
+        g_fota_status.last_error = FOTA_ERROR_NETWORK;
+        return ret;
+    }
+    
+    if (sha256_hex && memcmp(actual_sha, expected_sha, FOTA_SHA256_LEN) != 0) {
+        ESP_LOGE(TAG, "SHA-256 mismatch for %s", url);
+        g_fota_status.last_error = FOTA_ERROR_VERIFICATION;
+        return ESP_ERR_INVALID_CRC;
+    }
+    
+    return ESP_OK;
+}
+
+static const esp_partition_t* find_data_partition(const char* label, uint32_t size)
+{
+    const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                                label);
+    if (!partition) {
+        ESP_LOGE(TAG, "No '%s' partition in the partition table", label);
+        return NULL;
+    }
+    if (size > partition->size) {
+        ESP_LOGE(TAG, "Image (%lu bytes) does not fit the %lu byte '%s' partition",
+                 (unsigned long)size, (unsigned long)partition->size, label);
+        return NULL;
+    }
+    return partition;
+}
+
+static esp_err_t update_panel_ui(const fota_info_t* info)
+{
+    if (!g_tft_handler) {
+        ESP_LOGW(TAG, "TFT image available but no handler registered");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    
+    const esp_partition_t* partition = find_data_partition(FOTA_TFT_PARTITION_LABEL, info->tft_size);
+    if (!partition) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    esp_err_t ret = download_raw_image(info->tft_url, partition, 0, info->tft_size,
+                                       info->tft_sha256_hash[0] ? info->tft_sha256_hash : NULL);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    set_state(FOTA_STATE_INSTALLING);
+    return g_tft_handler(partition, info->tft_size);
+}
+
+static const fota_subboard_t* find_subboard(const char* name)
+{
+    for (int i = 0; i < g_subboard_count; i++) {
+        if (strcmp(g_subboards[i].name, name) == 0) {
+            return &g_subboards[i];
+        }
+    }
+    return NULL;
+}
+
+// The boards cannot report their version, so the last one programmed is remembered here
+static void load_subboard_version(const char* name, char* version, size_t len)
+{
+    char key[16];
+    nvs_handle_t nvs_handle;
+    
+    version[0] = '\0';
+    snprintf(key, sizeof(key), "%s%s", NVS_KEY_SUBBOARD_PREFIX, name);
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_str(nvs_handle, key, version, &len) != ESP_OK) {
+        version[0] = '\0';
+    }
+    nvs_close(nvs_handle);
+}
+
+static void save_subboard_version(const char* name, const char* version)
+{
+    char key[16];
+    nvs_handle_t nvs_handle;
+    
+    snprintf(key, sizeof(key), "%s%s", NVS_KEY_SUBBOARD_PREFIX, name);
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_str(nvs_handle, key, version) == ESP_OK) {
+        nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+}
+
+// Each board has its own slot, so every pending image is on flash before the install window
+// opens. A failed download only drops that board from this round.
+static uint8_t stage_subboard_images(const fota_info_t* info, bool staged[FOTA_SUBBOARD_MAX])
+{
+    uint8_t count = 0;
+    
+    for (int i = 0; i < FOTA_SUBBOARD_MAX; i++) {
+        staged[i] = false;
+    }
+    if (!info->subboard_update_available) {
+        return 0;
+    }
+    
+    const esp_partition_t* partition = find_data_partition(FOTA_SUBBOARD_PARTITION_LABEL,
+                                                           FOTA_SUBBOARD_MAX * FOTA_SUBBOARD_SLOT_SIZE);
+    if (!partition) {
+        return 0;
+    }
+    
+    for (int i = 0; i < info->subboard_count; i++) {
+        const fota_subboard_image_t* image = &info->subboards[i];
+        if (!image->update_needed) {
+            continue;
+        }
+        
+        esp_err_t ret = download_raw_image(image->url, partition, i * FOTA_SUBBOARD_SLOT_SIZE,
+                                           image->size, image->sha256_hash);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Sub-board %s image %s not staged: %s", image->board, image->version,
+                     esp_err_to_name(ret));
+            continue;
+        }
+        staged[i] = true;
+        count++;
+    }
+    return count;
+}
+
+// Boards in reset tri-state their TX, so only the target drives a shared RX line
+static void hold_other_subboards_in_reset(const fota_subboard_t* target, bool hold)
+{
+    for (int i = 0; i < g_subboard_count; i++) {
+        if (&g_subboards[i] != target) {
+            gpio_set_level(g_subboards[i].reset_pin, hold ? 0 : 1);
+        }
+    }
+}
+
+static void program_subboards(const fota_info_t* info, const bool staged[FOTA_SUBBOARD_MAX])
+{
+    const esp_partition_t* partition = find_data_partition(FOTA_SUBBOARD_PARTITION_LABEL,
+                                                           FOTA_SUBBOARD_MAX * FOTA_SUBBOARD_SLOT_SIZE);
+    if (!partition) {
+        return;
+    }
+    
+    for (int i = 0; i < info->subboard_count; i++) {
+        const fota_subboard_image_t* image = &info->subboards[i];
+        const fota_subboard_t* board = find_subboard(image->board);
+        if (!staged[i] || !board) {
+            continue;
+        }
+        
+        set_state(FOTA_STATE_INSTALLING);
+        update_progress(0, image->size);
+        
+        hold_other_subboards_in_reset(board, true);
+        esp_err_t ret = fota_stk500_program(board, partition, i * FOTA_SUBBOARD_SLOT_SIZE, image->size,
+                                            update_progress);
+        hold_other_subboards_in_reset(board, false);
+        
+        if (ret == ESP_OK) {
+            save_subboard_version(image->board, image->version);
+            ESP_LOGI(TAG, "Sub-board %s now runs %s", image->board, image->version);
+        } else {
+            // The version is not recorded, so the next update check offers the image again
+            ESP_LOGE(TAG, "Sub-board %s programming failed: %s", image->board, esp_err_to_name(ret));
+        }
+    }
+}
+
+static int64_t wall_clock_ms(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// The RTC keeps wall time across esp_restart(), so the reboot gap can be measured after the swap
+static void record_swap_start(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    nvs_set_i64(nvs_handle, NVS_KEY_SWAP_AT, wall_clock_ms());
+    nvs_erase_key(nvs_handle, NVS_KEY_SWAP_BOOT);
+    nvs_erase_key(nvs_handle, NVS_KEY_SWAP_READY);
+    nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+}
+
+static void record_swap_milestone(const char* key, bool finished)
+{
+    nvs_handle_t nvs_handle;
+    int64_t swap_at;
+    
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_i64(nvs_handle, NVS_KEY_SWAP_AT, &swap_at) == ESP_OK) {
+        int64_t elapsed = wall_clock_ms() - swap_at;
+        if (elapsed >= 0 && elapsed < UINT32_MAX) {
+            nvs_set_u32(nvs_handle, key, (uint32_t)elapsed);
+            ESP_LOGI(TAG, "Image swap: %s after %lld ms", key, (long long)elapsed);
+        }
+        if (finished) {
+            nvs_erase_key(nvs_handle, NVS_KEY_SWAP_AT);
+        }
+        nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+}
+
+static void health_timeout_callback(void* arg)
+{
+    ESP_LOGE(TAG, "New firmware not confirmed within %d s", FOTA_HEALTH_CHECK_TIMEOUT_MS / 1000);
+    fota_rollback_if_needed();
+}
+
+static esp_err_t start_health_check(void)
+{
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    esp_app_desc_t app_info;
+    if (esp_ota_get_partition_description(running, &app_info) == ESP_OK) {
+        ESP_LOGI(TAG, "Running %s from '%s'", app_info.version, running->label);
+    }
+    
+    if (!fota_is_pending_verify()) {
+        return ESP_OK;
+    }
+    
+    record_swap_milestone(NVS_KEY_SWAP_BOOT, false);
+    
+    const esp_timer_create_args_t timer_args = {
+        .callback = health_timeout_callback,
+        .name = "fota_health",
+    };
+    esp_err_t ret = esp_timer_create(&timer_args, &g_health_timer);
+    if (ret == ESP_OK) {
+        ret = esp_timer_start_once(g_health_timer, (uint64_t)FOTA_HEALTH_CHECK_TIMEOUT_MS * 1000);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start health check timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    ESP_LOGW(TAG, "Firmware pending verification - rollback in %d s unless confirmed",
+             FOTA_HEALTH_CHECK_TIMEOUT_MS / 1000);
+    return ESP_OK;
+}
+
 esp_err_t fota_manager_init(void)
 {
     if (g_fota_initialized) {
@@ -167,9 +947,12 @@ esp_err_t fota_manager_init(void)
     }
     
     memset(&g_fota_status, 0, sizeof(fota_status_t));
-    g_fota_status.state = FOTA_STATE_IDLE;
+    set_state(FOTA_STATE_IDLE);
     
-    esp_ota_mark_app_valid_cancel_rollback();
+    esp_err_t ret = start_health_check();
+    if (ret != ESP_OK) {
+        return ret;
+    }
     
     g_fota_initialized = true;
     ESP_LOGI(TAG, "FOTA Manager initialized");
@@ -188,65 +971,161 @@ esp_err_t fota_manager_deinit(void)
     return ESP_OK;
 }
 
+static bool is_registered_subboard(const char* board)
+{
+    return find_subboard(board) != NULL;
+}
+
+static esp_err_t feed_manifest(const char* data, int len, void* ctx)
+{
+    return fota_manifest_feed((fota_manifest_t*)ctx, data, len);
+}
+
+// The manifest only names boards this device registered; the size limit is per board
+static void check_subboard_images(fota_info_t* info)
+{
+    uint8_t kept = 0;
+    
+    for (int i = 0; i < info->subboard_count; i++) {
+        fota_subboard_image_t* image = &info->subboards[i];
+        const fota_subboard_t* board = find_subboard(image->board);
+        if (image->size > board->max_image_size) {
+            ESP_LOGW(TAG, "Sub-board %s image of %lu bytes does not fit", image->board, (unsigned long)image->size);
+            continue;
+        }
+        
+        // Any difference counts, so the server can also roll a board back
+        char installed[FOTA_VERSION_MAX_LEN];
+        load_subboard_version(image->board, installed, sizeof(installed));
+        image->update_needed = strcmp(installed, image->version) != 0;
+        info->subboard_update_available |= image->update_needed;
+        
+        ESP_LOGI(TAG, "Sub-board %s: installed %s, available %s", image->board,
+                 installed[0] ? installed : "unknown", image->version);
+        info->subboards[kept++] = *image;
+    }
+    info->subboard_count = kept;
+}
+
 esp_err_t fota_check_for_updates(const char* device_id, const char* auth_token, fota_info_t* info)
 {
     if (!g_fota_initialized || !info) {
         return ESP_ERR_INVALID_ARG;
     }
     
-    g_fota_status.state = FOTA_STATE_CHECKING;
-    
-    api_response_t response;
-    esp_err_t ret = api_client_check_firmware_update(device_id, auth_token, &response);
-    
-    if (ret == ESP_OK && response.success) {
-        cJSON* json = cJSON_Parse(response.data);
-        if (json) {
-            cJSON* version = cJSON_GetObjectItem(json, "version");
-            cJSON* url = cJSON_GetObjectItem(json, "download_url");
-            cJSON* hash = cJSON_GetObjectItem(json, "sha256");
-            cJSON* size = cJSON_GetObjectItem(json, "file_size");
-            
-            if (version && url && hash && size) {
-                strncpy(info->current_version, FIRMWARE_VERSION, FOTA_VERSION_MAX_LEN - 1);
-                strncpy(info->available_version, version->valuestring, FOTA_VERSION_MAX_LEN - 1);
-                strncpy(info->download_url, url->valuestring, FOTA_URL_MAX_LEN - 1);
-                strncpy(info->sha256_hash, hash->valuestring, FOTA_HASH_MAX_LEN - 1);
-                info->file_size = size->valueint;
-                
-                info->update_available = (strcmp(info->current_version, info->available_version) < 0);
-                
-                ESP_LOGI(TAG, "Current: %s, Available: %s, Update needed: %s",
-                        info->current_version, info->available_version,
-                        info->update_available ? "Yes" : "No");
-            }
-            
-            cJSON_Delete(json);
+    set_state(FOTA_STATE_CHECKING);
+    
+    // Parsed while it downloads, so the manifest size is not bounded by any response buffer
+    fota_manifest_t* manifest;
+    esp_err_t ret = fota_manifest_begin(info, is_registered_subboard, &manifest);
+    if (ret == ESP_OK) {
+        api_response_t response;
+        ret = api_client_check_firmware_update(device_id, auth_token, feed_manifest, manifest, &response);
+        if (ret == ESP_OK && !response.success) {
+            ESP_LOGW(TAG, "Firmware check failed: %s", response.message);
+            ret = ESP_FAIL;
         }
-    } else {
+        if (ret == ESP_OK) {
+            ret = fota_manifest_finish(manifest);
+        }
+        fota_manifest_free(manifest);
+    }
+    
+    if (ret != ESP_OK) {
         g_fota_status.last_error = FOTA_ERROR_SERVER;
+        set_state(FOTA_STATE_IDLE);
+        return ret;
     }
     
-    g_fota_status.state = FOTA_STATE_IDLE;
-    return ret;
+    strncpy(info->current_version, fota_get_current_version(), FOTA_VERSION_MAX_LEN - 1);
+    check_subboard_images(info);
+    
+    // "compression": "zlib" means download_url serves compressed_size bytes of zlib data
+    if (info->compression == FOTA_COMPRESSION_ZLIB && info->compressed_size == 0) {
+        ESP_LOGW(TAG, "Compressed image without compressed_size");
+    }
+    
+    if (info->available_version[0] && info->download_url[0] && info->sha256_hash[0] && info->file_size > 0) {
+        // Semantic order: 1.10.0 is newer than 1.9.0
+        info->update_available = fota_version_compare(info->current_version, info->available_version) < 0;
+        
+        ESP_LOGI(TAG, "Current: %s, Available: %s, Update needed: %s",
+                info->current_version, info->available_version,
+                info->update_available ? "Yes" : "No");
+    } else {
+        ESP_LOGW(TAG, "Manifest has no complete application image");
+    }
+    
+    set_state(FOTA_STATE_IDLE);
+    return ESP_OK;
+}
+
+// Staged: verified images wait on flash until the application says a reboot (or a sub-board
+// reset) is harmless - nobody on the pillow, pump idle, daytime
+static void wait_for_install_window(void)
+{
+    if (g_install_guard && !g_install_guard()) {
+        ESP_LOGI(TAG, "Update staged - waiting for the install window");
+        while (!g_install_guard()) {
+            vTaskDelay(pdMS_TO_TICKS(FOTA_INSTALL_POLL_MS));
+        }
+    }
 }
 
 static void fota_update_task(void* pvParameters)
 {
-    char* download_url = (char*)pvParameters;
+    fota_info_t* info = (fota_info_t*)pvParameters;
+    esp_err_t ret = ESP_OK;
     
-    esp_err_t ret = download_and_install_firmware(download_url);
+    if (info->update_available) {
+        ret = download_and_install_firmware(info);
+    }
     
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "FOTA download completed. Device will restart in 5 seconds...");
+    // Sub-board images: a failed board is retried later, the rest go ahead
+    bool staged[FOTA_SUBBOARD_MAX];
+    uint8_t staged_count = (ret == ESP_OK) ? stage_subboard_images(info, staged) : 0;
+    
+    if (ret == ESP_OK && (info->update_available || staged_count > 0)) {
+        wait_for_install_window();
+        
+        // The panel goes blank while its UI is flashed, so it waits for the window as well.
+        // A panel UI failure leaves the old UI in place; it does not hold back the firmware.
+        if (info->update_available && info->tft_size > 0) {
+            esp_err_t tft_ret = update_panel_ui(info);
+            if (tft_ret != ESP_OK) {
+                ESP_LOGE(TAG, "Panel UI update failed: %s", esp_err_to_name(tft_ret));
+            }
+            set_state(FOTA_STATE_COMPLETE);
+        }
+        
+        // Before the ESP32 restarts, so new firmware never talks to old sub-boards
+        if (staged_count > 0) {
+            program_subboards(info, staged);
+            set_state(FOTA_STATE_COMPLETE);
+        }
+    }
+    
+    if (ret == ESP_OK && info->update_available) {
+        ret = esp_ota_set_boot_partition(g_staged_partition);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to select the new image: %s", esp_err_to_name(ret));
+            g_fota_status.last_error = FOTA_ERROR_FLASH;
+        }
+    }
+    
+    if (ret == ESP_OK && info->update_available) {
+        ESP_LOGI(TAG, "Installing update. Device will restart in 5 seconds...");
+        record_swap_start();
         vTaskDelay(pdMS_TO_TICKS(5000));
         esp_restart();
+    } else if (ret == ESP_OK) {
+        set_state(FOTA_STATE_IDLE);
     } else {
         ESP_LOGE(TAG, "FOTA update failed");
-        g_fota_status.state = FOTA_STATE_ERROR;
+        set_state(FOTA_STATE_ERROR);
     }
     
-    free(download_url);
+    free(info);
     g_fota_task_handle = NULL;
     vTaskDelete(NULL);
 }
@@ -262,31 +1141,31 @@ esp_err_t fota_start_update(const char* device_id, const char* auth_token)
         return ESP_ERR_INVALID_STATE;
     }
     
-    fota_info_t info;
+    fota_info_t info = {0};
     esp_err_t ret = fota_check_for_updates(device_id, auth_token, &info);
     
-    if (ret != ESP_OK || !info.update_available) {
+    if (ret != ESP_OK || (!info.update_available && !info.subboard_update_available)) {
         ESP_LOGI(TAG, "No update available");
         return ESP_ERR_NOT_FOUND;
     }
     
-    char* url_copy = malloc(strlen(info.download_url) + 1);
-    if (!url_copy) {
+    fota_info_t* info_copy = malloc(sizeof(fota_info_t));
+    if (!info_copy) {
         return ESP_ERR_NO_MEM;
     }
-    strcpy(url_copy, info.download_url);
+    memcpy(info_copy, &info, sizeof(fota_info_t));
     
     BaseType_t task_ret = xTaskCreate(
         fota_update_task,
         "fota_update",
         FOTA_TASK_STACK_SIZE,
-        url_copy,
-        FOTA_TASK_PRIORITY,
+        info_copy,
+        g_background_mode ? FOTA_BACKGROUND_TASK_PRIORITY : FOTA_TASK_PRIORITY,
         &g_fota_task_handle
     );
     
     if (task_ret != pdPASS) {
-        free(url_copy);
+        free(info_copy);
         return ESP_FAIL;
     }
     
@@ -300,6 +1179,81 @@ esp_err_t fota_set_progress_callback(fota_progress_callback_t callback)
     return ESP_OK;
 }
 
+esp_err_t fota_set_background_mode(bool enabled, uint32_t max_kbytes_per_sec)
+{
+    if (g_fota_task_handle != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    g_background_mode = enabled;
+    g_background_rate_bps = max_kbytes_per_sec * 1024;
+    ESP_LOGI(TAG, "Background mode %s (cap %lu KB/s)", enabled ? "on" : "off", (unsigned long)max_kbytes_per_sec);
+    return ESP_OK;
+}
+
+esp_err_t fota_set_install_guard(fota_install_guard_t guard)
+{
+    g_install_guard = guard;
+    return ESP_OK;
+}
+
+esp_err_t fota_register_subboard(const fota_subboard_t* board)
+{
+    if (!board || !board->name || strlen(board->name) >= FOTA_SUBBOARD_NAME_MAX_LEN ||
+        board->max_image_size > FOTA_SUBBOARD_SLOT_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (find_subboard(board->name)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (g_subboard_count >= FOTA_SUBBOARD_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    // Released (pulled high on the board) until programming needs it
+    gpio_set_level(board->reset_pin, 1);
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << board->reset_pin,
+        .mode = GPIO_MODE_OUTPUT_OD,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    esp_err_t ret = gpio_config(&io_conf);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    g_subboards[g_subboard_count++] = *board;
+    ESP_LOGI(TAG, "Sub-board %s registered on UART %d", board->name, board->uart_num);
+    return ESP_OK;
+}
+
+esp_err_t fota_get_swap_timing(uint32_t* boot_ms, uint32_t* ready_ms)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    ret = nvs_get_u32(nvs_handle, NVS_KEY_SWAP_BOOT, boot_ms);
+    if (ret == ESP_OK) {
+        // Not confirmed (yet) is reported as 0
+        if (nvs_get_u32(nvs_handle, NVS_KEY_SWAP_READY, ready_ms) != ESP_OK) {
+            *ready_ms = 0;
+        }
+    }
+    nvs_close(nvs_handle);
+    return ret;
+}
+
+esp_err_t fota_set_tft_handler(fota_tft_handler_t handler)
+{
+    g_tft_handler = handler;
+    return ESP_OK;
+}
+
 esp_err_t fota_get_status(fota_status_t* status)
 {
     if (!status) {
@@ -325,14 +1279,43 @@ esp_err_t fota_rollback_if_needed(void)
     return ESP_OK;
 }
 
+bool fota_is_pending_verify(void)
+{
+    esp_ota_img_states_t ota_state;
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    
+    return esp_ota_get_state_partition(running, &ota_state) == ESP_OK &&
+           ota_state == ESP_OTA_IMG_PENDING_VERIFY;
+}
+
+// Cheap when there is nothing to confirm, so callers may invoke it on every healthy event
 esp_err_t fota_mark_running_partition_valid(void)
 {
-    return esp_ota_mark_app_valid_cancel_rollback();
+    if (!fota_is_pending_verify()) {
+        return ESP_OK;
+    }
+    
+    if (g_health_timer) {
+        esp_timer_stop(g_health_timer);
+        esp_timer_delete(g_health_timer);
+        g_health_timer = NULL;
+    }
+    
+    esp_err_t ret = esp_ota_mark_app_valid_cancel_rollback();
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Health check passed - firmware %s confirmed", fota_get_current_version());
+        record_swap_milestone(NVS_KEY_SWAP_READY, true);
+    } else {
+        ESP_LOGE(TAG, "Failed to confirm firmware: %s", esp_err_to_name(ret));
+    }
+    return ret;
 }
 
 const char* fota_get_current_version(void)
 {
-    return FIRMWARE_VERSION;
+    // PROJECT_VER from the top-level CMakeLists.txt, baked into the running image, so it moves
+    // with every installed update
+    return esp_app_get_description()->version;
 }
 
 bool fota_is_running_from_factory(void)
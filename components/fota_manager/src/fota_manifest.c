@@ -0,0 +1,623 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "fota_manifest.h"
+
+#define TAG "FOTA_MANIFEST"
+#define MANIFEST_VALUE_MAX_LEN FOTA_URL_MAX_LEN     // Longest field any destination can hold
+
+typedef enum {
+    LEX_VALUE,              // Expecting a value
+    LEX_KEY,                // Expecting a key or the end of an object
+    LEX_COLON,
+    LEX_AFTER_VALUE,        // Expecting ',' or the end of the container
+    LEX_STRING,
+    LEX_ESCAPE,
+    LEX_UNICODE,
+    LEX_BARE,               // Number, true, false or null
+    LEX_DONE
+} lex_state_t;
+
+typedef struct {
+    char kind;                              // '{' or '['
+    char key[FOTA_MANIFEST_KEY_MAX_LEN];    // Key this container is the value of, "" in arrays
+} frame_t;
+
+// One element of "components" or "subboards", committed when its object closes since the
+// type may come after the fields it decides about
+typedef struct {
+    char type[16];
+    char board[FOTA_SUBBOARD_NAME_MAX_LEN];
+    char version[FOTA_VERSION_MAX_LEN];
+    char url[FOTA_URL_MAX_LEN];
+    char sha256[FOTA_HASH_MAX_LEN];
+    uint32_t size;
+    fota_compression_t compression;
+    uint32_t compressed_size;
+} component_t;
+
+struct fota_manifest {
+    fota_info_t* info;
+    fota_manifest_board_filter_t filter;
+    lex_state_t state;
+    bool string_is_key;
+    uint8_t depth;
+    frame_t stack[FOTA_MANIFEST_MAX_DEPTH];
+    char key[FOTA_MANIFEST_KEY_MAX_LEN];    // Key of the value being parsed
+    char value[MANIFEST_VALUE_MAX_LEN];
+    size_t value_len;
+    bool value_overflow;
+    uint32_t unicode;
+    uint8_t unicode_digits;
+    component_t component;
+    esp_err_t err;
+};
+
+static esp_err_t fail(fota_manifest_t* manifest, const char* what)
+{
+    ESP_LOGE(TAG, "Malformed manifest: %s", what);
+    manifest->err = ESP_ERR_INVALID_RESPONSE;
+    return manifest->err;
+}
+
+static bool key_is(const char* key, const char* name)
+{
+    return strcmp(key, name) == 0;
+}
+
+// Unknown encodings are treated as "none" so the SHA-256 check rejects the image rather than
+// silently feeding it to the wrong decoder
+static fota_compression_t compression_of(const char* value)
+{
+    if (strcmp(value, "zlib") == 0) {
+        return FOTA_COMPRESSION_ZLIB;
+    }
+    if (strcmp(value, "none") != 0) {
+        ESP_LOGW(TAG, "Unsupported compression '%s'", value);
+    }
+    return FOTA_COMPRESSION_NONE;
+}
+
+static void take_string(fota_manifest_t* manifest, bool is_string, char* dst, size_t size)
+{
+    if (!is_string) {
+        ESP_LOGW(TAG, "'%s' is not a string - ignored", manifest->key);
+        return;
+    }
+    if (manifest->value_overflow || manifest->value_len >= size) {
+        ESP_LOGE(TAG, "'%s' does not fit in %u bytes", manifest->key, (unsigned)(size - 1));
+        manifest->err = ESP_ERR_INVALID_SIZE;
+        return;
+    }
+    memcpy(dst, manifest->value, manifest->value_len + 1);
+}
+
+static void take_number(fota_manifest_t* manifest, bool is_string, uint32_t* dst)
+{
+    char* end;
+    unsigned long long number = strtoull(manifest->value, &end, 10);
+    
+    if (is_string || manifest->value_overflow || manifest->value[0] < '0' || manifest->value[0] > '9' ||
+        *end != '\0' || number > UINT32_MAX) {
+        ESP_LOGW(TAG, "'%s' is not a byte count - ignored", manifest->key);
+        return;
+    }
+    *dst = (uint32_t)number;
+}
+
+static void take_compression(fota_manifest_t* manifest, bool is_string, fota_compression_t* dst)
+{
+    if (is_string) {
+        *dst = compression_of(manifest->value);
+    }
+}
+
+static void top_field(fota_manifest_t* manifest, bool is_string)
+{
+    fota_info_t* info = manifest->info;
+    const char* key = manifest->key;
+    
+    if (key_is(key, "version")) {
+        take_string(manifest, is_string, info->available_version, sizeof(info->available_version));
+    } else if (key_is(key, "download_url")) {
+        take_string(manifest, is_string, info->download_url, sizeof(info->download_url));
+    } else if (key_is(key, "sha256")) {
+        take_string(manifest, is_string, info->sha256_hash, sizeof(info->sha256_hash));
+    } else if (key_is(key, "file_size")) {
+        take_number(manifest, is_string, &info->file_size);
+    } else if (key_is(key, "compression")) {
+        take_compression(manifest, is_string, &info->compression);
+    } else if (key_is(key, "compressed_size")) {
+        take_number(manifest, is_string, &info->compressed_size);
+    } else if (key_is(key, "tft_url")) {
+        take_string(manifest, is_string, info->tft_url, sizeof(info->tft_url));
+    } else if (key_is(key, "tft_size")) {
+        take_number(manifest, is_string, &info->tft_size);
+    } else if (key_is(key, "tft_sha256")) {
+        take_string(manifest, is_string, info->tft_sha256_hash, sizeof(info->tft_sha256_hash));
+    }
+}
+
+// Patch from base_version to the app version, at the top level or inside the app component
+static void delta_field(fota_manifest_t* manifest, bool is_string)
+{
+    fota_info_t* info = manifest->info;
+    const char* key = manifest->key;
+    
+    if (key_is(key, "url")) {
+        take_string(manifest, is_string, info->delta_url, sizeof(info->delta_url));
+    } else if (key_is(key, "size")) {
+        take_number(manifest, is_string, &info->delta_size);
+    } else if (key_is(key, "base_version")) {
+        take_string(manifest, is_string, info->delta_base_version, sizeof(info->delta_base_version));
+    } else if (key_is(key, "compression")) {
+        take_compression(manifest, is_string, &info->delta_compression);
+    }
+}
+
+static void component_field(fota_manifest_t* manifest, bool is_string)
+{
+    component_t* component = &manifest->component;
+    const char* key = manifest->key;
+    
+    if (key_is(key, "type")) {
+        take_string(manifest, is_string, component->type, sizeof(component->type));
+    } else if (key_is(key, "board")) {
+        take_string(manifest, is_string, component->board, sizeof(component->board));
+    } else if (key_is(key, "version")) {
+        take_string(manifest, is_string, component->version, sizeof(component->version));
+    } else if (key_is(key, "url")) {
+        take_string(manifest, is_string, component->url, sizeof(component->url));
+    } else if (key_is(key, "sha256")) {
+        take_string(manifest, is_string, component->sha256, sizeof(component->sha256));
+    } else if (key_is(key, "size")) {
+        take_number(manifest, is_string, &component->size);
+    } else if (key_is(key, "compression")) {
+        take_compression(manifest, is_string, &component->compression);
+    } else if (key_is(key, "compressed_size")) {
+        take_number(manifest, is_string, &component->compressed_size);
+    }
+}
+
+static void commit_subboard(fota_manifest_t* manifest)
+{
+    const component_t* component = &manifest->component;
+    fota_info_t* info = manifest->info;
+    
+    if (!component->board[0] || !component->version[0] || !component->url[0] ||
+        !component->sha256[0] || component->size == 0) {
+        ESP_LOGW(TAG, "Incomplete sub-board entry");
+        return;
+    }
+    if (manifest->filter && !manifest->filter(component->board)) {
+        ESP_LOGW(TAG, "Manifest lists unknown sub-board '%s'", component->board);
+        return;
+    }
+    if (info->subboard_count >= FOTA_SUBBOARD_MAX) {
+        ESP_LOGW(TAG, "More than %d sub-board images - '%s' ignored", FOTA_SUBBOARD_MAX, component->board);
+        return;
+    }
+    
+    fota_subboard_image_t* image = &info->subboards[info->subboard_count++];
+    strcpy(image->board, component->board);
+    strcpy(image->version, component->version);
+    strcpy(image->url, component->url);
+    strcpy(image->sha256_hash, component->sha256);
+    image->size = component->size;
+}
+
+static void commit_component(fota_manifest_t* manifest, bool subboard_list)
+{
+    const component_t* component = &manifest->component;
+    fota_info_t* info = manifest->info;
+    
+    if (subboard_list || key_is(component->type, "subboard")) {
+        commit_subboard(manifest);
+    } else if (key_is(component->type, "app")) {
+        if (component->version[0]) {
+            strcpy(info->available_version, component->version);
+        }
+        strcpy(info->download_url, component->url);
+        strcpy(info->sha256_hash, component->sha256);
+        info->file_size = component->size;
+        info->compression = component->compression;
+        info->compressed_size = component->compressed_size;
+    } else if (key_is(component->type, "tft")) {
+        strcpy(info->tft_url, component->url);
+        strcpy(info->tft_sha256_hash, component->sha256);
+        info->tft_size = component->size;
+    } else {
+        ESP_LOGI(TAG, "Skipping component of type '%s'", component->type);
+    }
+}
+
+// depth counts open containers; stack[0] is the root object
+static bool in_component_list(const fota_manifest_t* manifest, bool* subboard_list)
+{
+    const frame_t* list = &manifest->stack[1];
+    if (manifest->depth < 3 || list->kind != '[' || manifest->stack[2].kind != '{') {
+        return false;
+    }
+    *subboard_list = key_is(list->key, "subboards");
+    return *subboard_list || key_is(list->key, "components");
+}
+
+static void on_value(fota_manifest_t* manifest, bool is_string)
+{
+    bool subboard_list;
+    
+    if (manifest->depth == 1) {
+        top_field(manifest, is_string);
+    } else if (manifest->depth == 2 && manifest->stack[1].kind == '{' && key_is(manifest->stack[1].key, "delta")) {
+        delta_field(manifest, is_string);
+    } else if (in_component_list(manifest, &subboard_list)) {
+        if (manifest->depth == 3) {
+            component_field(manifest, is_string);
+        } else if (manifest->depth == 4 && !subboard_list && key_is(manifest->stack[3].key, "delta")) {
+            delta_field(manifest, is_string);
+        }
+    }
+}
+
+static esp_err_t push(fota_manifest_t* manifest, char kind)
+{
+    if (manifest->depth == 0 && kind != '{') {
+        return fail(manifest, "not an object");
+    }
+    if (manifest->depth == FOTA_MANIFEST_MAX_DEPTH) {
+        return fail(manifest, "nested too deeply");
+    }
+    
+    frame_t* frame = &manifest->stack[manifest->depth++];
+    frame->kind = kind;
+    strcpy(frame->key, manifest->key);
+    manifest->key[0] = '\0';
+    
+    bool subboard_list;
+    if (manifest->depth == 3 && in_component_list(manifest, &subboard_list)) {
+        memset(&manifest->component, 0, sizeof(component_t));
+    }
+    
+    manifest->state = (kind == '{') ? LEX_KEY : LEX_VALUE;
+    return ESP_OK;
+}
+
+static esp_err_t pop(fota_manifest_t* manifest, char kind)
+{
+    if (manifest->depth == 0 || manifest->stack[manifest->depth - 1].kind != kind) {
+        return fail(manifest, "mismatched bracket");
+    }
+    
+    bool subboard_list;
+    if (manifest->depth == 3 && in_component_list(manifest, &subboard_list)) {
+        commit_component(manifest, subboard_list);
+    }
+    
+    manifest->depth--;
+    manifest->key[0] = '\0';
+    manifest->state = (manifest->depth == 0) ? LEX_DONE : LEX_AFTER_VALUE;
+    return ESP_OK;
+}
+
+static void append(fota_manifest_t* manifest, char c)
+{
+    if (manifest->value_len < MANIFEST_VALUE_MAX_LEN - 1) {
+        manifest->value[manifest->value_len++] = c;
+    } else {
+        manifest->value_overflow = true;
+    }
+}
+
+static void append_code_point(fota_manifest_t* manifest, uint32_t cp)
+{
+    if (cp < 0x80) {
+        append(manifest, cp);
+    } else if (cp < 0x800) {
+        append(manifest, 0xc0 | (cp >> 6));
+        append(manifest, 0x80 | (cp & 0x3f));
+    } else {
+        append(manifest, 0xe0 | (cp >> 12));
+        append(manifest, 0x80 | ((cp >> 6) & 0x3f));
+        append(manifest, 0x80 | (cp & 0x3f));
+    }
+}
+
+static void start_token(fota_manifest_t* manifest, lex_state_t state, bool is_key)
+{
+    manifest->state = state;
+    manifest->string_is_key = is_key;
+    manifest->value_len = 0;
+    manifest->value_overflow = false;
+}
+
+static void end_string(fota_manifest_t* manifest)
+{
+    manifest->value[manifest->value_len] = '\0';
+    
+    if (manifest->string_is_key) {
+        // Too long to be any key we know, so it must not match one by truncation
+        if (manifest->value_overflow || manifest->value_len >= FOTA_MANIFEST_KEY_MAX_LEN) {
+            strcpy(manifest->key, "?");
+        } else {
+            strcpy(manifest->key, manifest->value);
+        }
+        manifest->state = LEX_COLON;
+    } else {
+        on_value(manifest, true);
+        manifest->state = LEX_AFTER_VALUE;
+    }
+}
+
+static bool is_bare_char(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           c == '-' || c == '+' || c == '.';
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static char unescape(char c)
+{
+    switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            return c;
+        case 'b': return '\b';
+        case 'f': return '\f';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 't': return '\t';
+        default: return 0;
+    }
+}
+
+// Inside strings and bare tokens; returns true when c was consumed
+static bool lex_token(fota_manifest_t* manifest, char c)
+{
+    switch (manifest->state) {
+        case LEX_STRING:
+            if (c == '"') {
+                end_string(manifest);
+            } else if (c == '\\') {
+                manifest->state = LEX_ESCAPE;
+            } else if ((unsigned char)c < 0x20) {
+                fail(manifest, "control character in string");
+            } else {
+                append(manifest, c);
+            }
+            return true;
+        case LEX_ESCAPE:
+            if (c == 'u') {
+                manifest->unicode = 0;
+                manifest->unicode_digits = 0;
+                manifest->state = LEX_UNICODE;
+            } else if (unescape(c)) {
+                append(manifest, unescape(c));
+                manifest->state = LEX_STRING;
+            } else {
+                fail(manifest, "bad escape");
+            }
+            return true;
+        case LEX_UNICODE:
+            if (hex_value(c) < 0) {
+                fail(manifest, "bad \\u escape");
+                return true;
+            }
+            manifest->unicode = (manifest->unicode << 4) | hex_value(c);
+            if (++manifest->unicode_digits == 4) {
+                append_code_point(manifest, manifest->unicode);
+                manifest->state = LEX_STRING;
+            }
+            return true;
+        case LEX_BARE:
+            if (is_bare_char(c)) {
+                append(manifest, c);
+                return true;
+            }
+            // The delimiter ends the token and is then handled as structure
+            manifest->value[manifest->value_len] = '\0';
+            on_value(manifest, false);
+            manifest->state = LEX_AFTER_VALUE;
+            return false;
+        default:
+            return false;
+    }
+}
+
+static void lex_structure(fota_manifest_t* manifest, char c)
+{
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        return;
+    }
+    
+    switch (manifest->state) {
+        case LEX_VALUE:
+            if (c == '{' || c == '[') {
+                push(manifest, c);
+            } else if (c == ']' && manifest->depth > 0) {
+                pop(manifest, '[');
+            } else if (manifest->depth == 0) {
+                fail(manifest, "not an object");
+            } else if (c == '"') {
+                start_token(manifest, LEX_STRING, false);
+            } else if (is_bare_char(c)) {
+                start_token(manifest, LEX_BARE, false);
+                append(manifest, c);
+            } else {
+                fail(manifest, "unexpected character");
+            }
+            break;
+        case LEX_KEY:
+            if (c == '"') {
+                start_token(manifest, LEX_STRING, true);
+            } else if (c == '}') {
+                pop(manifest, '{');
+            } else {
+                fail(manifest, "expected a key");
+            }
+            break;
+        case LEX_COLON:
+            if (c == ':') {
+                manifest->state = LEX_VALUE;
+            } else {
+                fail(manifest, "expected ':'");
+            }
+            break;
+        case LEX_AFTER_VALUE:
+            if (c == ',') {
+                manifest->state = (manifest->stack[manifest->depth - 1].kind == '{') ? LEX_KEY : LEX_VALUE;
+            } else if (c == '}' || c == ']') {
+                pop(manifest, c == '}' ? '{' : '[');
+            } else {
+                fail(manifest, "expected ',' or end of container");
+            }
+            break;
+        default:
+            fail(manifest, "data after the end of the manifest");
+            break;
+    }
+}
+
+esp_err_t fota_manifest_begin(fota_info_t* info, fota_manifest_board_filter_t filter, fota_manifest_t** out)
+{
+    if (!info || !out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    fota_manifest_t* manifest = calloc(1, sizeof(fota_manifest_t));
+    if (!manifest) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    memset(info, 0, sizeof(fota_info_t));
+    manifest->info = info;
+    manifest->filter = filter;
+    manifest->state = LEX_VALUE;
+    manifest->err = ESP_OK;
+    
+    *out = manifest;
+    return ESP_OK;
+}
+
+esp_err_t fota_manifest_feed(fota_manifest_t* manifest, const char* data, size_t len)
+{
+    for (size_t i = 0; i < len && manifest->err == ESP_OK; i++) {
+        if (!lex_token(manifest, data[i])) {
+            lex_structure(manifest, data[i]);
+        }
+    }
+    return manifest->err;
+}
+
+esp_err_t fota_manifest_finish(fota_manifest_t* manifest)
+{
+    if (manifest->err != ESP_OK) {
+        return manifest->err;
+    }
+    if (manifest->state != LEX_DONE) {
+        ESP_LOGE(TAG, "Manifest ends inside the JSON document");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+void fota_manifest_free(fota_manifest_t* manifest)
+{
+    free(manifest);
+}
+
+static const char* skip_version_prefix(const char* version)
+{
+    return (*version == 'v' || *version == 'V') ? version + 1 : version;
+}
+
+static unsigned long next_version_number(const char** version)
+{
+    char* end;
+    unsigned long number = strtoul(*version, &end, 10);
+    *version = end;
+    if (**version == '.') {
+        (*version)++;
+    }
+    return number;
+}
+
+static bool all_digits(const char* s, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] < '0' || s[i] > '9') {
+            return false;
+        }
+    }
+    return len > 0;
+}
+
+// Dot-separated identifiers: numeric ones by value and below alphanumeric ones, the rest in
+// ASCII order; a shorter list that matches so far sorts first
+static int compare_prerelease(const char* a, const char* b)
+{
+    while (true) {
+        size_t len_a = strcspn(a, ".+");
+        size_t len_b = strcspn(b, ".+");
+        if (len_a == 0 || len_b == 0) {
+            return (len_a == 0 && len_b == 0) ? 0 : (len_a == 0 ? -1 : 1);
+        }
+        
+        bool numeric_a = all_digits(a, len_a);
+        bool numeric_b = all_digits(b, len_b);
+        int cmp;
+        if (numeric_a && numeric_b) {
+            cmp = (len_a != len_b) ? (int)len_a - (int)len_b : memcmp(a, b, len_a);
+        } else if (numeric_a != numeric_b) {
+            cmp = numeric_a ? -1 : 1;
+        } else {
+            cmp = memcmp(a, b, len_a < len_b ? len_a : len_b);
+            if (cmp == 0) {
+                cmp = (int)len_a - (int)len_b;
+            }
+        }
+        if (cmp != 0) {
+            return cmp < 0 ? -1 : 1;
+        }
+        
+        a += len_a;
+        b += len_b;
+        if (*a == '.') {
+            a++;
+        }
+        if (*b == '.') {
+            b++;
+        }
+    }
+}
+
+int fota_version_compare(const char* a, const char* b)
+{
+    a = skip_version_prefix(a);
+    b = skip_version_prefix(b);
+    
+    // Missing parts count as 0, so "1.2" == "1.2.0"
+    for (int part = 0; part < 3; part++) {
+        unsigned long number_a = next_version_number(&a);
+        unsigned long number_b = next_version_number(&b);
+        if (number_a != number_b) {
+            return number_a < number_b ? -1 : 1;
+        }
+    }
+    
+    // A pre-release sorts before the release; build metadata never affects the order
+    const char* pre_a = (*a == '-') ? a + 1 : NULL;
+    const char* pre_b = (*b == '-') ? b + 1 : NULL;
+    if (!pre_a || !pre_b) {
+        return (pre_a ? -1 : 0) + (pre_b ? 1 : 0);
+    }
+    return compare_prerelease(pre_a, pre_b);
+}
@@ -0,0 +1,41 @@
+#ifndef FOTA_MANIFEST_H
+#define FOTA_MANIFEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "fota_manager.h"
+
+// Incremental JSON parser for the firmware-check manifest. The response is fed in whatever
+// pieces the HTTP client delivers, so the manifest has no size limit; RAM is one value buffer
+// plus the nesting stack. Unknown keys and components are skipped, so the server can add
+// fields without breaking older devices. A known field that does not fit its fota_info_t
+// buffer fails the parse instead of being cut short. Private to fota_manager.
+//
+// Accepted layout - the flat legacy fields and/or a component list:
+//   {"version": ..., "download_url": ..., "sha256": ..., "file_size": ...,
+//    "compression": ..., "compressed_size": ..., "tft_url": ..., "tft_size": ..., "tft_sha256": ...,
+//    "delta": {"url", "size", "base_version", "compression"},
+//    "subboards": [{"board", "version", "url", "sha256", "size"}],
+//    "components": [{"type": "app" | "tft" | "subboard", "board", "version", "url", "sha256",
+//                    "size", "compression", "compressed_size", "delta": {...}}]}
+
+#define FOTA_MANIFEST_MAX_DEPTH 8
+#define FOTA_MANIFEST_KEY_MAX_LEN 24
+
+typedef struct fota_manifest fota_manifest_t;
+
+// Sub-board entries are only kept for boards the filter accepts (NULL keeps all)
+typedef bool (*fota_manifest_board_filter_t)(const char* board);
+
+// Clears info and fills it as the manifest streams in; current_version and update flags are
+// left to the caller
+esp_err_t fota_manifest_begin(fota_info_t* info, fota_manifest_board_filter_t filter, fota_manifest_t** out);
+esp_err_t fota_manifest_feed(fota_manifest_t* manifest, const char* data, size_t len);
+esp_err_t fota_manifest_finish(fota_manifest_t* manifest);
+void fota_manifest_free(fota_manifest_t* manifest);
+
+// Semantic version order (MAJOR.MINOR.PATCH[-pre][+build], optional leading 'v'); <0, 0, >0
+int fota_version_compare(const char* a, const char* b);
+
+#endif
@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "fota_pipeline.h"
+
+#define TAG "FOTA_PIPELINE"
+#define PIPELINE_BLOCKS 2
+
+typedef struct {
+    uint8_t index;
+    uint32_t len;               // 0 marks the end of the stream
+} pipeline_block_t;
+
+typedef struct {
+    uint8_t* blocks[PIPELINE_BLOCKS];
+    QueueHandle_t free_queue;
+    QueueHandle_t full_queue;
+    SemaphoreHandle_t writer_done;
+    fota_stream_write_t write;
+    void* write_ctx;
+    volatile esp_err_t write_err;
+} pipeline_t;
+
+static void writer_task(void* arg)
+{
+    pipeline_t* pipeline = (pipeline_t*)arg;
+    pipeline_block_t block;
+    
+    while (xQueueReceive(pipeline->full_queue, &block, portMAX_DELAY) == pdTRUE && block.len > 0) {
+        // After a failure the remaining blocks are only recycled so the reader can stop cleanly
+        if (pipeline->write_err == ESP_OK) {
+            pipeline->write_err = pipeline->write(pipeline->blocks[block.index], block.len, pipeline->write_ctx);
+        }
+        xQueueSend(pipeline->free_queue, &block.index, portMAX_DELAY);
+    }
+    
+    xSemaphoreGive(pipeline->writer_done);
+    vTaskDelete(NULL);
+}
+
+static void pipeline_free(pipeline_t* pipeline)
+{
+    for (int i = 0; i < PIPELINE_BLOCKS; i++) {
+        free(pipeline->blocks[i]);
+    }
+    if (pipeline->free_queue) {
+        vQueueDelete(pipeline->free_queue);
+    }
+    if (pipeline->full_queue) {
+        vQueueDelete(pipeline->full_queue);
+    }
+    if (pipeline->writer_done) {
+        vSemaphoreDelete(pipeline->writer_done);
+    }
+}
+
+static void wait_while_paused(const fota_pipeline_throttle_t* throttle, fota_pipeline_stats_t* stats)
+{
+    if (!throttle || !throttle->should_pause || !throttle->should_pause()) {
+        return;
+    }
+    
+    uint32_t waited = 0;
+    while (waited < FOTA_PIPELINE_MAX_PAUSE_MS && throttle->should_pause()) {
+        vTaskDelay(pdMS_TO_TICKS(FOTA_PIPELINE_PAUSE_POLL_MS));
+        waited += FOTA_PIPELINE_PAUSE_POLL_MS;
+    }
+    stats->paused_ms += waited;
+}
+
+// Sleeps until the bytes read so far fit the cap, measured from the start of the transfer
+static void pace(const fota_pipeline_throttle_t* throttle, uint32_t bytes, int64_t start_us)
+{
+    if (!throttle || throttle->max_bytes_per_sec == 0) {
+        return;
+    }
+    
+    int64_t due_us = start_us + (int64_t)bytes * 1000000 / throttle->max_bytes_per_sec;
+    int64_t ahead_us = due_us - esp_timer_get_time();
+    if (ahead_us >= 1000 * portTICK_PERIOD_MS) {
+        vTaskDelay(pdMS_TO_TICKS(ahead_us / 1000));
+    }
+}
+
+static void log_rate(const char* what, uint32_t bytes, int64_t elapsed_us)
+{
+    uint32_t kbps = elapsed_us > 0 ? (uint32_t)((uint64_t)bytes * 1000000 / 1024 / elapsed_us) : 0;
+    ESP_LOGI(TAG, "%s %lu KB in %lu ms (%lu KB/s)", what, (unsigned long)(bytes / 1024),
+             (unsigned long)(elapsed_us / 1000), (unsigned long)kbps);
+}
+
+esp_err_t fota_pipeline_run(esp_http_client_handle_t client, uint32_t start, uint32_t total,
+                            fota_stream_write_t write, void* write_ctx,
+                            const fota_pipeline_throttle_t* throttle,
+                            fota_pipeline_progress_t progress, fota_pipeline_stats_t* stats)
+{
+    pipeline_t pipeline = {
+        .write = write,
+        .write_ctx = write_ctx,
+        .write_err = ESP_OK,
+    };
+    
+    stats->received = start;
+    stats->elapsed_ms = 0;
+    stats->paused_ms = 0;
+    stats->read_failed = false;
+    
+    for (int i = 0; i < PIPELINE_BLOCKS; i++) {
+        pipeline.blocks[i] = malloc(FOTA_PIPELINE_BLOCK_SIZE);
+    }
+    pipeline.free_queue = xQueueCreate(PIPELINE_BLOCKS, sizeof(uint8_t));
+    pipeline.full_queue = xQueueCreate(PIPELINE_BLOCKS + 1, sizeof(pipeline_block_t));
+    pipeline.writer_done = xSemaphoreCreateBinary();
+    if (!pipeline.blocks[0] || !pipeline.blocks[1] || !pipeline.free_queue ||
+        !pipeline.full_queue || !pipeline.writer_done) {
+        pipeline_free(&pipeline);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    for (uint8_t i = 0; i < PIPELINE_BLOCKS; i++) {
+        xQueueSend(pipeline.free_queue, &i, 0);
+    }
+    
+    // Same priority as the caller so neither side starves the other on a single core
+    if (xTaskCreate(writer_task, "fota_writer", FOTA_PIPELINE_WRITER_STACK_SIZE, &pipeline,
+                    uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+        pipeline_free(&pipeline);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    esp_err_t ret = ESP_OK;
+    int64_t start_us = esp_timer_get_time();
+    int64_t last_log_us = start_us;
+    bool eof = false;
+    
+    // With a cap, read in slices of ~100 ms worth of data so pacing stays smooth
+    size_t max_read = FOTA_PIPELINE_BLOCK_SIZE;
+    if (throttle && throttle->max_bytes_per_sec > 0 && throttle->max_bytes_per_sec / 10 < max_read) {
+        max_read = throttle->max_bytes_per_sec / 10 > 512 ? throttle->max_bytes_per_sec / 10 : 512;
+    }
+    
+    while (!eof && ret == ESP_OK) {
+        pipeline_block_t block = { .len = 0 };
+        xQueueReceive(pipeline.free_queue, &block.index, portMAX_DELAY);
+        if (pipeline.write_err != ESP_OK) {
+            break;
+        }
+        
+        uint8_t* buf = pipeline.blocks[block.index];
+        while (block.len < FOTA_PIPELINE_BLOCK_SIZE) {
+            wait_while_paused(throttle, stats);
+            
+            size_t want = FOTA_PIPELINE_BLOCK_SIZE - block.len;
+            int n = esp_http_client_read(client, (char*)buf + block.len, want < max_read ? want : max_read);
+            if (n < 0) {
+                ESP_LOGE(TAG, "Download read error at %lu bytes", (unsigned long)(stats->received + block.len));
+                stats->read_failed = true;
+                ret = ESP_FAIL;
+                break;
+            }
+            if (n == 0) {
+                eof = true;
+                break;
+            }
+            if (stats->received + block.len + n > total) {
+                ESP_LOGE(TAG, "Download is larger than the announced %lu bytes", (unsigned long)total);
+                ret = ESP_ERR_INVALID_SIZE;
+                break;
+            }
+            block.len += n;
+            pace(throttle, stats->received - start + block.len, start_us + stats->paused_ms * 1000LL);
+        }
+        
+        if (ret != ESP_OK || block.len == 0) {
+            xQueueSend(pipeline.free_queue, &block.index, 0);
+            break;
+        }
+        
+        xQueueSend(pipeline.full_queue, &block, portMAX_DELAY);
+        stats->received += block.len;
+        if (progress) {
+            progress(stats->received, total);
+        }
+        
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - last_log_us >= FOTA_PIPELINE_LOG_INTERVAL_MS * 1000LL) {
+            last_log_us = now_us;
+            ESP_LOGI(TAG, "%lu%% (%lu / %lu bytes)", (unsigned long)((uint64_t)stats->received * 100 / total),
+                     (unsigned long)stats->received, (unsigned long)total);
+        }
+    }
+    
+    // Drains whatever is queued, so on return every received byte has been written (or rejected)
+    pipeline_block_t end = { .index = 0, .len = 0 };
+    xQueueSend(pipeline.full_queue, &end, portMAX_DELAY);
+    xSemaphoreTake(pipeline.writer_done, portMAX_DELAY);
+    
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    stats->elapsed_ms = (uint32_t)(elapsed_us / 1000);
+    log_rate("Received", stats->received - start, elapsed_us);
+    if (stats->paused_ms > 0) {
+        ESP_LOGI(TAG, "Paused %lu ms for foreground requests", (unsigned long)stats->paused_ms);
+    }
+    
+    if (ret == ESP_OK) {
+        ret = pipeline.write_err;
+    }
+    pipeline_free(&pipeline);
+    return ret;
+}
@@ -0,0 +1,42 @@
+#ifndef FOTA_PIPELINE_H
+#define FOTA_PIPELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "fota_delta.h"
+
+// Double-buffered download: the calling task fills one block from the HTTP stream while a
+// writer task pushes the other through the decode/flash chain, so TLS receive and flash
+// erase/write overlap instead of alternating. Private to fota_manager.
+
+#define FOTA_PIPELINE_BLOCK_SIZE (16 * 1024)
+#define FOTA_PIPELINE_WRITER_STACK_SIZE 4096
+#define FOTA_PIPELINE_LOG_INTERVAL_MS 2000
+#define FOTA_PIPELINE_PAUSE_POLL_MS 50
+#define FOTA_PIPELINE_MAX_PAUSE_MS 20000    // Keep reading eventually so the server does not drop us
+
+typedef void (*fota_pipeline_progress_t)(uint32_t received, uint32_t total);
+
+// Background shaping; the reader stops pulling from the socket, so TCP flow control
+// slows the sender instead of data piling up in lwIP buffers
+typedef struct {
+    uint32_t max_bytes_per_sec;         // 0 = unlimited
+    bool (*should_pause)(void);         // Polled before every read; NULL = never pause
+} fota_pipeline_throttle_t;
+
+typedef struct {
+    uint32_t received;          // Absolute offset in the transfer, including any resumed prefix
+    uint32_t elapsed_ms;
+    uint32_t paused_ms;
+    bool read_failed;           // Network side failed (as opposed to the write chain)
+} fota_pipeline_stats_t;
+
+// Reads until EOF or total bytes, whichever comes first; more than total is an error
+esp_err_t fota_pipeline_run(esp_http_client_handle_t client, uint32_t start, uint32_t total,
+                            fota_stream_write_t write, void* write_ctx,
+                            const fota_pipeline_throttle_t* throttle,
+                            fota_pipeline_progress_t progress, fota_pipeline_stats_t* stats);
+
+#endif
@@ -0,0 +1,241 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/uart.h"
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "fota_stk500.h"
+
+#define TAG "FOTA_STK500"
+
+#define STK_OK 0x10
+#define STK_INSYNC 0x14
+#define CRC_EOP 0x20
+#define STK_GET_SYNC 0x30
+#define STK_ENTER_PROGMODE 0x50
+#define STK_LEAVE_PROGMODE 0x51
+#define STK_LOAD_ADDRESS 0x55
+#define STK_PROG_PAGE 0x64
+#define STK_READ_PAGE 0x74
+#define STK_READ_SIGN 0x75
+
+#define STK_RX_BUFFER_SIZE 512
+#define STK_MAX_PAGE_SIZE 256
+
+// Static: programming runs in the FOTA task, whose stack is sized for the download path
+static uint8_t s_page[STK_MAX_PAGE_SIZE];
+static uint8_t s_readback[STK_MAX_PAGE_SIZE];
+
+static esp_err_t read_exact(uart_port_t uart, uint8_t* buf, size_t len, uint32_t timeout_ms)
+{
+    size_t got = 0;
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(timeout_ms);
+    
+    while (got < len) {
+        TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(deadline - now) <= 0) {
+            return ESP_ERR_TIMEOUT;
+        }
+        int n = uart_read_bytes(uart, buf + got, len - got, deadline - now);
+        if (n < 0) {
+            return ESP_FAIL;
+        }
+        got += n;
+    }
+    return ESP_OK;
+}
+
+// Every command ends in CRC_EOP and every reply is framed STK_INSYNC [payload] STK_OK
+static esp_err_t transact(uart_port_t uart, const uint8_t* cmd, size_t cmd_len,
+                          const uint8_t* data, size_t data_len, uint8_t* reply, size_t reply_len)
+{
+    static const uint8_t eop = CRC_EOP;
+    uint8_t frame;
+    
+    uart_write_bytes(uart, cmd, cmd_len);
+    if (data_len > 0) {
+        uart_write_bytes(uart, data, data_len);
+    }
+    uart_write_bytes(uart, &eop, 1);
+    
+    esp_err_t ret = read_exact(uart, &frame, 1, FOTA_STK500_REPLY_TIMEOUT_MS);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (frame != STK_INSYNC) {
+        ESP_LOGW(TAG, "Command 0x%02x: out of sync (0x%02x)", cmd[0], frame);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (reply_len > 0) {
+        ret = read_exact(uart, reply, reply_len, FOTA_STK500_REPLY_TIMEOUT_MS);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    ret = read_exact(uart, &frame, 1, FOTA_STK500_REPLY_TIMEOUT_MS);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return frame == STK_OK ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+}
+
+static void reset_board(const fota_subboard_t* board)
+{
+    gpio_set_level(board->reset_pin, 0);
+    vTaskDelay(pdMS_TO_TICKS(FOTA_STK500_RESET_PULSE_MS));
+    gpio_set_level(board->reset_pin, 1);
+    vTaskDelay(pdMS_TO_TICKS(FOTA_STK500_BOOT_DELAY_MS));
+}
+
+static esp_err_t get_sync(const fota_subboard_t* board)
+{
+    static const uint8_t cmd[] = { STK_GET_SYNC };
+    
+    for (int attempt = 0; attempt < FOTA_STK500_SYNC_ATTEMPTS; attempt++) {
+        // The running sketch may still have been talking when the reset hit
+        uart_flush_input(board->uart_num);
+        if (transact(board->uart_num, cmd, sizeof(cmd), NULL, 0, NULL, 0) == ESP_OK) {
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_TIMEOUT;
+}
+
+static esp_err_t check_signature(const fota_subboard_t* board)
+{
+    static const uint8_t cmd[] = { STK_READ_SIGN };
+    uint8_t signature[3];
+    
+    esp_err_t ret = transact(board->uart_num, cmd, sizeof(cmd), NULL, 0, signature, sizeof(signature));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (memcmp(signature, board->signature, sizeof(signature)) != 0) {
+        ESP_LOGE(TAG, "%s: device signature %02x %02x %02x, expected %02x %02x %02x", board->name,
+                 signature[0], signature[1], signature[2],
+                 board->signature[0], board->signature[1], board->signature[2]);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    return ESP_OK;
+}
+
+// Flash addresses are in 16-bit words
+static esp_err_t load_address(uart_port_t uart, uint32_t byte_address)
+{
+    uint16_t word = byte_address / 2;
+    uint8_t cmd[] = { STK_LOAD_ADDRESS, word & 0xff, word >> 8 };
+    return transact(uart, cmd, sizeof(cmd), NULL, 0, NULL, 0);
+}
+
+static esp_err_t write_and_verify_page(const fota_subboard_t* board, uint32_t address, size_t len)
+{
+    uint8_t prog[] = { STK_PROG_PAGE, len >> 8, len & 0xff, 'F' };
+    uint8_t read[] = { STK_READ_PAGE, len >> 8, len & 0xff, 'F' };
+    
+    esp_err_t ret = load_address(board->uart_num, address);
+    if (ret == ESP_OK) {
+        ret = transact(board->uart_num, prog, sizeof(prog), s_page, len, NULL, 0);
+    }
+    if (ret == ESP_OK) {
+        ret = load_address(board->uart_num, address);
+    }
+    if (ret == ESP_OK) {
+        ret = transact(board->uart_num, read, sizeof(read), NULL, 0, s_readback, len);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s: page 0x%04lx failed: %s", board->name, (unsigned long)address, esp_err_to_name(ret));
+        return ret;
+    }
+    
+    if (memcmp(s_page, s_readback, len) != 0) {
+        ESP_LOGE(TAG, "%s: verify mismatch in page 0x%04lx", board->name, (unsigned long)address);
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t program_session(const fota_subboard_t* board, const esp_partition_t* partition,
+                                 uint32_t offset, uint32_t size, fota_stk500_progress_t progress)
+{
+    static const uint8_t enter[] = { STK_ENTER_PROGMODE };
+    static const uint8_t leave[] = { STK_LEAVE_PROGMODE };
+    
+    reset_board(board);
+    
+    esp_err_t ret = get_sync(board);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s: bootloader not responding", board->name);
+        return ret;
+    }
+    
+    ret = check_signature(board);
+    if (ret == ESP_OK) {
+        ret = transact(board->uart_num, enter, sizeof(enter), NULL, 0, NULL, 0);
+    }
+    
+    for (uint32_t address = 0; ret == ESP_OK && address < size; address += board->page_size) {
+        size_t len = (size - address < board->page_size) ? size - address : board->page_size;
+        
+        ret = esp_partition_read(partition, offset + address, s_page, len);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Flash read at 0x%lx failed: %s", (unsigned long)(offset + address), esp_err_to_name(ret));
+            break;
+        }
+        
+        ret = write_and_verify_page(board, address, len);
+        if (ret == ESP_OK && progress) {
+            progress(address + len, size);
+        }
+    }
+    
+    // Optiboot starts the application (via its watchdog) once programming mode is left
+    esp_err_t leave_ret = transact(board->uart_num, leave, sizeof(leave), NULL, 0, NULL, 0);
+    return ret != ESP_OK ? ret : leave_ret;
+}
+
+esp_err_t fota_stk500_program(const fota_subboard_t* board, const esp_partition_t* partition,
+                              uint32_t offset, uint32_t size, fota_stk500_progress_t progress)
+{
+    if (!board || !partition || size == 0 || board->page_size == 0 || board->page_size > STK_MAX_PAGE_SIZE ||
+        size > board->max_image_size || offset + size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    // The link is only ours for the duration of the programming run
+    uart_config_t uart_config = {
+        .baud_rate = board->baud_rate,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+#if SOC_UART_LP_NUM >= 1
+    if (board->uart_num >= SOC_UART_HP_NUM) {
+        uart_config.lp_source_clk = LP_UART_SCLK_DEFAULT;
+    }
+#endif
+    esp_err_t ret = uart_driver_install(board->uart_num, STK_RX_BUFFER_SIZE, 0, 0, NULL, 0);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s: UART %d unavailable: %s", board->name, board->uart_num, esp_err_to_name(ret));
+        return ret;
+    }
+    uart_param_config(board->uart_num, &uart_config);
+    uart_set_pin(board->uart_num, board->tx_pin, board->rx_pin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    
+    ESP_LOGI(TAG, "Programming %s: %lu bytes at %lu baud", board->name,
+             (unsigned long)size, (unsigned long)board->baud_rate);
+    
+    ret = program_session(board, partition, offset, size, progress);
+    if (ret != ESP_OK) {
+        // A fresh reset gives a half-written board a clean bootloader session for the retry
+        ESP_LOGW(TAG, "%s: retrying from the start", board->name);
+        ret = program_session(board, partition, offset, size, progress);
+    }
+    
+    uart_driver_delete(board->uart_num);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "%s programmed and verified", board->name);
+    }
+    return ret;
+}
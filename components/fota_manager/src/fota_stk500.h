@@ -0,0 +1,26 @@
+#ifndef FOTA_STK500_H
+#define FOTA_STK500_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "fota_manager.h"
+
+// STK500v1 client for the Optiboot bootloader on the AVR sub-boards. Each page is written and
+// read back before the next one is sent, so a bad page fails the update where it happened.
+// The bootloader itself is fuse-protected; an interrupted programming run leaves the board in
+// Optiboot after its next reset and can simply be repeated. Private to fota_manager.
+
+#define FOTA_STK500_SYNC_ATTEMPTS 10
+#define FOTA_STK500_REPLY_TIMEOUT_MS 500
+#define FOTA_STK500_RESET_PULSE_MS 10
+#define FOTA_STK500_BOOT_DELAY_MS 50        // Optiboot listens for ~1 s after an external reset
+
+typedef void (*fota_stk500_progress_t)(uint32_t bytes_verified, uint32_t total_bytes);
+
+// Programs size bytes of the raw (objcopy -O binary) image at partition offset into the board's
+// application flash, starting at address 0
+esp_err_t fota_stk500_program(const fota_subboard_t* board, const esp_partition_t* partition,
+                              uint32_t offset, uint32_t size, fota_stk500_progress_t progress);
+
+#endif
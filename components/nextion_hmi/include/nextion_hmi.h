@@ -3,6 +3,7 @@
 
 #include "esp_err.h"
 #include "driver/uart.h"
+#include "esp_partition.h"
 #include <stdbool.h>
 
 #ifdef __cplusplus
@@ -14,12 +15,33 @@ extern "C" {
 #define NEXTION_TX_PIN 12
 #define NEXTION_BAUD_RATE 9600
 #define NEXTION_BUF_SIZE 1024
+#define NEXTION_FRAME_GAP_MS 10
+
+#define NEXTION_PAGE_SETUP 0
+#define NEXTION_PAGE_HOME 1
+
+#define NEXTION_FIELD_MAX_LEN 128
+#define NEXTION_BATCH_SIZE 512
+#define NEXTION_RENDER_BUDGET_BYTES 256  // ~0.27s of wire time at 9600 baud per render pass
+
+#define NEXTION_WAVEFORM_UART_SHARE_PCT 25     // Share of the UART byte rate plotting may use
+#define NEXTION_WAVEFORM_FLUSH_MS 100
+#define NEXTION_WAVEFORM_RING_SIZE 256         // Decimated points kept per trace (power of two)
+#define NEXTION_WAVEFORM_ADDT_MIN 4            // Fewer pending points than this go out as "add"
+#define NEXTION_WAVEFORM_ADDT_MAX 120          // Panel limit for one addt transfer
+#define NEXTION_WAVEFORM_HANDSHAKE_MS 100
+
+#define NEXTION_TFT_UPLOAD_BAUD 921600
+#define NEXTION_TFT_CHUNK_SIZE 4096            // Panel acknowledges every 4 KB with 0x05
+#define NEXTION_TFT_ACK_TIMEOUT_MS 3000
+#define NEXTION_TFT_MAX_ATTEMPTS 3
+#define NEXTION_TFT_RETRY_DELAY_MS 3000        // Lets the panel drop out of download mode before a retry
 
 typedef enum {
     NEXTION_EVENT_NONE = 0x00,
     NEXTION_EVENT_TOUCH_PRESS = 0x65,
-    NEXTION_EVENT_TOUCH_RELEASE = 0x66,
-    NEXTION_EVENT_CURRENT_PAGE = 0x67,
+    NEXTION_EVENT_CURRENT_PAGE = 0x66,   // Reply to "sendme" - put sendme in each page's Preinitialize event
+    NEXTION_EVENT_TOUCH_COORDINATE = 0x67,
     NEXTION_EVENT_STRING_DATA = 0x70
 } nextion_event_type_t;
 
@@ -28,19 +50,105 @@ typedef enum {
     NEXTION_CMD_GO_SETTINGS = 1,
     NEXTION_CMD_GO_WIFI_LIST = 2,
     NEXTION_CMD_REFRESH_DATA = 3,
-    NEXTION_CMD_FACTORY_RESET = 4
+    NEXTION_CMD_FACTORY_RESET = 4,
+    NEXTION_CMD_MAX
 } nextion_command_type_t;
 
+// Touch-to-action trace points, in path order
+typedef enum {
+    NEXTION_STAGE_UART_RX = 0,      // First byte of the frame read from the UART
+    NEXTION_STAGE_DECODED,          // Frame decoded into an event
+    NEXTION_STAGE_CALLBACK,         // Application callback entered (event handed off)
+    NEXTION_STAGE_ACTION_START,     // Command handler started its work
+    NEXTION_STAGE_ACTION_DONE,      // Network/display work finished
+    NEXTION_STAGE_MAX
+} nextion_latency_stage_t;
+
+#define NEXTION_LATENCY_SAMPLES 32
+#define NEXTION_LATENCY_BUDGET_MS 300
+
+typedef struct {
+    uint32_t count;                 // Samples in the window (at most NEXTION_LATENCY_SAMPLES)
+    uint32_t total_p50_ms;
+    uint32_t total_p90_ms;
+    uint32_t total_p99_ms;
+    uint32_t total_max_ms;
+    uint32_t stage_p50_ms[NEXTION_STAGE_MAX - 1];  // Time spent reaching each stage from the previous one
+    uint32_t over_budget;           // Samples above NEXTION_LATENCY_BUDGET_MS since boot
+} nextion_latency_stats_t;
+
 typedef struct {
     nextion_event_type_t event;
     uint8_t page_id;
     uint8_t component_id;
     uint8_t touch_event;
+    bool page_changed;              // The panel is on a newly shown page; pending fields need a render
     nextion_command_type_t command;
     char string_data[256];
+    int64_t stage_us[NEXTION_STAGE_MAX];
 } nextion_event_t;
 
 typedef void (*nextion_event_callback_t)(nextion_event_t* event);
+typedef void (*nextion_tft_progress_callback_t)(uint32_t bytes_acked, uint32_t total_bytes);
+
+// Application data fields that can be bound to panel components
+typedef enum {
+    NEXTION_FIELD_SETUP_TITLE = 0,
+    NEXTION_FIELD_SETUP_MESSAGE,
+    NEXTION_FIELD_HOME_TEMPERATURE,
+    NEXTION_FIELD_HOME_WEATHER,
+    NEXTION_FIELD_HOME_SLEEP_SCORE,
+    NEXTION_FIELD_HOME_NOISE_LEVEL,
+    NEXTION_FIELD_HOME_ALARM,
+    NEXTION_FIELD_HOME_CLOCK,
+    NEXTION_FIELD_HOME_ALARM_HOUR,
+    NEXTION_FIELD_HOME_ROOM_TEMP,
+    NEXTION_FIELD_HOME_ROOM_HUMIDITY,
+    NEXTION_FIELD_HOME_ALARM_MINUTE,
+    NEXTION_FIELD_HOME_FOTA_STATUS,
+    NEXTION_FIELD_MAX
+} nextion_field_t;
+
+typedef enum {
+    NEXTION_REFRESH_ON_CHANGE = 0,  // Send only when the rendered text differs from what the panel shows
+    NEXTION_REFRESH_ALWAYS,         // Send on every render pass
+    NEXTION_REFRESH_ONCE            // Send once per page visit
+} nextion_refresh_t;
+
+typedef enum {
+    NEXTION_PRIORITY_HIGH = 0,      // Always sent, ignores the render budget
+    NEXTION_PRIORITY_NORMAL,
+    NEXTION_PRIORITY_LOW
+} nextion_priority_t;
+
+typedef void (*nextion_formatter_t)(const char* value, char* out, size_t out_len);
+
+typedef struct {
+    nextion_field_t field;
+    uint8_t page_id;
+    const char* component;
+    nextion_formatter_t format;     // NULL sends the value as-is
+    nextion_refresh_t refresh;
+    nextion_priority_t priority;
+} nextion_binding_t;
+
+// Live traces plotted on waveform components
+typedef enum {
+    NEXTION_WAVE_HEART_RATE = 0,
+    NEXTION_WAVE_PRESSURE,
+    NEXTION_WAVE_MAX
+} nextion_wave_t;
+
+typedef struct {
+    nextion_wave_t wave;
+    uint8_t page_id;
+    uint8_t component_id;           // Waveform object id in the HMI project (add/addt take ids, not names)
+    uint8_t channel;
+    uint8_t height;                 // Component height in pixels - samples are scaled to 0..height
+    uint8_t decimation;             // Raw samples averaged into one plotted point
+    int32_t min_value;
+    int32_t max_value;
+} nextion_waveform_binding_t;
 
 esp_err_t nextion_hmi_init(void);
 esp_err_t nextion_hmi_deinit(void);
@@ -52,6 +160,36 @@ esp_err_t nextion_set_event_callback(nextion_event_callback_t callback);
 esp_err_t nextion_show_provisioning_message(const char* ssid, const char* password);
 esp_err_t nextion_show_status(const char* status);
 
+// Screen bindings - set field values, then render the visible page in one batch.
+// Fields bound to a hidden page stay pending until the panel shows that page; the event
+// callback should call nextion_render() for any event with page_changed set to flush them
+// (a touch can be the first sign of a page switch when its sendme reply was lost).
+// The callback runs in the UART reader task and must hand real work off rather than do it.
+esp_err_t nextion_set_field(nextion_field_t field, const char* value);
+esp_err_t nextion_render(void);
+uint8_t nextion_get_visible_page(void);
+
+// Waveform streaming - samples are decimated into a ring buffer and plotted by a background
+// task with add/addt, limited to NEXTION_WAVEFORM_UART_SHARE_PCT of the UART byte rate.
+// Points pushed while the waveform's page is hidden are kept (up to the ring size) and sent on return.
+// The task and rings are created by the first pushed sample, so an unused waveform costs no RAM.
+esp_err_t nextion_waveform_push_sample(nextion_wave_t wave, int32_t value);
+esp_err_t nextion_waveform_clear(nextion_wave_t wave);
+
+// TFT upload (whmi-wris) - streams a .tft image from a flash partition to the panel in
+// acknowledged 4 KB chunks at NEXTION_TFT_UPLOAD_BAUD. Blocks until the panel has the whole
+// file; a failed session is retried and the panel's 0x08 reply resumes it at the last acked offset.
+// All other panel traffic is refused while it runs.
+esp_err_t nextion_tft_upload(const esp_partition_t* partition, uint32_t tft_size,
+                             nextion_tft_progress_callback_t progress);
+bool nextion_tft_upload_in_progress(void);
+
+// Touch-to-action latency tracing, aggregated per NEXTION_CMD_*
+void nextion_latency_mark(nextion_event_t* event, nextion_latency_stage_t stage);
+void nextion_latency_commit(const nextion_event_t* event);
+esp_err_t nextion_latency_get_stats(nextion_command_type_t command, nextion_latency_stats_t* stats);
+void nextion_latency_log_summary(void);
+
 // Page 0 - Setup/Configuration Mode
 esp_err_t nextion_show_initial_setup_message(void);
 esp_err_t nextion_show_provisioning_info(const char* ssid, const char* password);
@@ -63,7 +201,7 @@ esp_err_t nextion_show_fota_status(const char* status);
 esp_err_t nextion_clear_fota_status(void);
 
 // Page 1 - Home Mode with heartbeat data
-esp_err_t nextion_show_heartbeat_data_detailed(const char* current_time_kr, const char* alarm_time_display, float temperature, float humidity);
+esp_err_t nextion_show_heartbeat_data_detailed(float temperature, float humidity);
 
 #ifdef __cplusplus
 }
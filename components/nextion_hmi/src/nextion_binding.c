@@ -0,0 +1,248 @@
+#include "nextion_hmi.h"
+#include "nextion_internal.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char* TAG = "NEXTION_BIND";
+
+static void format_celsius(const char* value, char* out, size_t out_len)
+{
+    snprintf(out, out_len, "%s°C", value);
+}
+
+// Page/component layout of the HMI project. New data costs a row here, not new UART code.
+// Every page listed here needs `sendme` in its Preinitialize Event in the HMI project: the
+// 0x66 reply is how the reader learns the user navigated on the panel. A page without it is
+// only noticed on its first touch, and its bound fields stay stale until then.
+static const nextion_binding_t s_bindings[] = {
+    // Page 0 - Setup/Configuration Mode
+    { NEXTION_FIELD_SETUP_TITLE,        NEXTION_PAGE_SETUP, "t0",  NULL,           NEXTION_REFRESH_ON_CHANGE, NEXTION_PRIORITY_HIGH   },
+    { NEXTION_FIELD_SETUP_MESSAGE,      NEXTION_PAGE_SETUP, "t1",  NULL,           NEXTION_REFRESH_ON_CHANGE, NEXTION_PRIORITY_HIGH   },
+
+    // Page 1 - Home Mode
+    { NEXTION_FIELD_HOME_CLOCK,         NEXTION_PAGE_HOME,  "t5",  NULL,           NEXTION_REFRESH_ON_CHANGE, NEXTION_PRIORITY_HIGH   },
+    { NEXTION_FIELD_HOME_FOTA_STATUS,   NEXTION_PAGE_HOME,  "t49", NULL,           NEXTION_REFRESH_ON_CHANGE, NEXTION_PRIORITY_HIGH   },
+    { NEXTION_FIELD_HOME_ALARM_HOUR,    NEXTION_PAGE_HOME,  "t6",  NULL,           NEXTION_REFRESH_ON_CHANGE, NEXTION_PRIORITY_NORMAL },
+    { NEXTION_FIELD_HOME_ALARM_MINUTE,  NEXTION_PAGE_HOME,  "t9",  NULL,           NEXTION_REFRESH_ON_CHANGE, NEXTION_PRIORITY_NORMAL },
+    { NEXTION_FIELD_HOME_TEMPERATURE,   NEXTION_PAGE_HOME,  "t0",  format_celsius, NEXTION_REFRESH_ON_CHANGE, NEXTION_PRIORITY_NORMAL },
+    { NEXTION_FIELD_HOME_ROOM_TEMP,     NEXTION_PAGE_HOME,  "t7",  NULL,           NEXTION_REFRESH_ON_CHANGE, NEXTION_PRIORITY_NORMAL },
+    { NEXTION_FIELD_HOME_ROOM_HUMIDITY, NEXTION_PAGE_HOME,  "t8",  NULL,           NEXTION_REFRESH_ON_CHANGE, NEXTION_PRIORITY_NORMAL },
+    { NEXTION_FIELD_HOME_WEATHER,       NEXTION_PAGE_HOME,  "t1",  NULL,           NEXTION_REFRESH_ON_CHANGE, NEXTION_PRIORITY_LOW    },
+    { NEXTION_FIELD_HOME_SLEEP_SCORE,   NEXTION_PAGE_HOME,  "t2",  NULL,           NEXTION_REFRESH_ON_CHANGE, NEXTION_PRIORITY_LOW    },
+    { NEXTION_FIELD_HOME_NOISE_LEVEL,   NEXTION_PAGE_HOME,  "t3",  NULL,           NEXTION_REFRESH_ON_CHANGE, NEXTION_PRIORITY_LOW    },
+    { NEXTION_FIELD_HOME_ALARM,         NEXTION_PAGE_HOME,  "t4",  NULL,           NEXTION_REFRESH_ON_CHANGE, NEXTION_PRIORITY_LOW    },
+};
+
+#define BINDING_COUNT (sizeof(s_bindings) / sizeof(s_bindings[0]))
+
+static char s_values[NEXTION_FIELD_MAX][NEXTION_FIELD_MAX_LEN];
+static bool s_has_value[NEXTION_FIELD_MAX];
+
+// What the panel currently shows for each binding, so unchanged fields are skipped
+static char s_rendered[BINDING_COUNT][NEXTION_FIELD_MAX_LEN];
+static bool s_rendered_valid[BINDING_COUNT];
+
+// Bindings whose field changed since they were last sent (deferred while their page is hidden)
+static bool s_pending[BINDING_COUNT];
+
+static uint8_t s_render_order[BINDING_COUNT];
+static uint8_t s_visible_page = NEXTION_PAGE_SETUP;
+
+static char s_batch[NEXTION_BATCH_SIZE];
+static size_t s_batch_len = 0;
+
+static SemaphoreHandle_t s_lock = NULL;
+
+static esp_err_t batch_flush(void)
+{
+    if (s_batch_len == 0) {
+        return ESP_OK;
+    }
+    
+    esp_err_t ret = nextion_uart_write(s_batch, s_batch_len);
+    s_batch_len = 0;
+    return ret;
+}
+
+static esp_err_t batch_append(const char* command, size_t len)
+{
+    if (s_batch_len + len + NEXTION_TERMINATOR_LEN > sizeof(s_batch)) {
+        esp_err_t ret = batch_flush();
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    
+    memcpy(s_batch + s_batch_len, command, len);
+    s_batch_len += len;
+    memcpy(s_batch + s_batch_len, NEXTION_TERMINATOR, NEXTION_TERMINATOR_LEN);
+    s_batch_len += NEXTION_TERMINATOR_LEN;
+    return ESP_OK;
+}
+
+esp_err_t nextion_binding_init(void)
+{
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    
+    // Stable insertion sort of the table by priority; the table itself stays declarative
+    for (size_t i = 0; i < BINDING_COUNT; i++) {
+        size_t j = i;
+        while (j > 0 && s_bindings[s_render_order[j - 1]].priority > s_bindings[i].priority) {
+            s_render_order[j] = s_render_order[j - 1];
+            j--;
+        }
+        s_render_order[j] = i;
+    }
+    
+    memset(s_rendered_valid, 0, sizeof(s_rendered_valid));
+    memset(s_pending, 0, sizeof(s_pending));
+    s_batch_len = 0;
+    return ESP_OK;
+}
+
+void nextion_binding_deinit(void)
+{
+    if (s_lock) {
+        vSemaphoreDelete(s_lock);
+        s_lock = NULL;
+    }
+}
+
+bool nextion_binding_on_page_change(uint8_t page_id)
+{
+    if (!s_lock) {
+        return false;
+    }
+    
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    
+    // A page switch reloads the page's components with their HMI defaults
+    bool changed = (s_visible_page != page_id);
+    s_visible_page = page_id;
+    for (size_t i = 0; i < BINDING_COUNT; i++) {
+        if (s_bindings[i].page_id == page_id) {
+            s_rendered_valid[i] = false;
+        }
+    }
+    
+    xSemaphoreGive(s_lock);
+    return changed;
+}
+
+esp_err_t nextion_set_field(nextion_field_t field, const char* value)
+{
+    if (field >= NEXTION_FIELD_MAX || !value) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!s_has_value[field] || strncmp(s_values[field], value, NEXTION_FIELD_MAX_LEN - 1) != 0) {
+        strncpy(s_values[field], value, NEXTION_FIELD_MAX_LEN - 1);
+        s_values[field][NEXTION_FIELD_MAX_LEN - 1] = '\0';
+        s_has_value[field] = true;
+    
+        for (size_t i = 0; i < BINDING_COUNT; i++) {
+            if (s_bindings[i].field == field) {
+                s_pending[i] = true;
+            }
+        }
+    }
+    xSemaphoreGive(s_lock);
+    
+    return ESP_OK;
+}
+
+esp_err_t nextion_render(void)
+{
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    
+    esp_err_t ret = ESP_OK;
+    int budget = NEXTION_RENDER_BUDGET_BYTES;
+    int sent = 0;
+    int deferred = 0;
+    
+    for (size_t n = 0; n < BINDING_COUNT && ret == ESP_OK; n++) {
+        uint8_t idx = s_render_order[n];
+        const nextion_binding_t* binding = &s_bindings[idx];
+    
+        if (binding->page_id != s_visible_page || !s_has_value[binding->field]) {
+            continue;
+        }
+        if (binding->refresh == NEXTION_REFRESH_ONCE && s_rendered_valid[idx]) {
+            continue;
+        }
+        if (binding->refresh != NEXTION_REFRESH_ALWAYS && s_rendered_valid[idx] && !s_pending[idx]) {
+            continue;
+        }
+    
+        char text[NEXTION_FIELD_MAX_LEN];
+        if (binding->format) {
+            binding->format(s_values[binding->field], text, sizeof(text));
+        } else {
+            strcpy(text, s_values[binding->field]);
+        }
+    
+        if (binding->refresh == NEXTION_REFRESH_ON_CHANGE && s_rendered_valid[idx] &&
+            strcmp(text, s_rendered[idx]) == 0) {
+            s_pending[idx] = false;
+            continue;
+        }
+    
+        char command[NEXTION_FIELD_MAX_LEN + 32];
+        int len = snprintf(command, sizeof(command), "%s.txt=\"%s\"", binding->component, text);
+        if (len < 0 || len >= (int)sizeof(command)) {
+            ESP_LOGW(TAG, "Rendered text for %s truncated", binding->component);
+            len = sizeof(command) - 1;
+        }
+    
+        // Leave lower priority fields dirty for the next pass once the wire budget is spent
+        int cost = len + NEXTION_TERMINATOR_LEN;
+        if (binding->priority != NEXTION_PRIORITY_HIGH && cost > budget) {
+            deferred++;
+            continue;
+        }
+    
+        ret = batch_append(command, len);
+        if (ret == ESP_OK) {
+            budget -= cost;
+            strcpy(s_rendered[idx], text);
+            s_rendered_valid[idx] = true;
+            s_pending[idx] = false;
+            sent++;
+        }
+    }
+    
+    if (ret == ESP_OK) {
+        ret = batch_flush();
+    } else {
+        s_batch_len = 0;
+    }
+    
+    xSemaphoreGive(s_lock);
+    
+    if (sent > 0 || deferred > 0) {
+        ESP_LOGD(TAG, "Render page %d: %d sent, %d deferred", s_visible_page, sent, deferred);
+    }
+    
+    return ret;
+}
+
+uint8_t nextion_get_visible_page(void)
+{
+    return s_visible_page;
+}
@@ -1,10 +1,13 @@
 #include "nextion_hmi.h"
+#include "nextion_internal.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "driver/gpio.h"
 #include "driver/uart.h"
+#include "esp_timer.h"
 #include <string.h>
 
 static const char* TAG = "NEXTION_HMI";
@@ -12,24 +15,54 @@ static const char* TAG = "NEXTION_HMI";
 static bool nextion_initialized = false;
 static nextion_event_callback_t event_callback = NULL;
 static TaskHandle_t nextion_task_handle = NULL;
+static SemaphoreHandle_t s_uart_lock = NULL;
+static SemaphoreHandle_t s_rx_lock = NULL;
+
+// Set while a TFT upload owns the link: the reader stops and other writers are refused
+static volatile bool s_link_exclusive = false;
+
+// The reader only records the page here; the pending flush (nextion_render) is UART write
+// work and belongs to whoever handles the event, not to this task
+static bool nextion_handle_page_shown(uint8_t page_id)
+{
+    ESP_LOGI(TAG, "Panel is showing page %d", page_id);
+    return nextion_binding_on_page_change(page_id);
+}
 
 static void nextion_task(void* pvParameters)
 {
-    uint8_t data[NEXTION_BUF_SIZE];
+    // Static so the page-flush render path fits in this task's small stack
+    static uint8_t data[NEXTION_BUF_SIZE];
     
     while (1) {
-        int len = uart_read_bytes(NEXTION_UART_NUM, data, NEXTION_BUF_SIZE - 1, pdMS_TO_TICKS(100));
+        if (s_link_exclusive) {
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+        
+        xSemaphoreTake(s_rx_lock, portMAX_DELAY);
+        
+        // Block for the first byte only, so its timestamp is the real arrival time,
+        // then collect the rest of the burst with a short inter-frame gap
+        int len = uart_read_bytes(NEXTION_UART_NUM, data, 1, pdMS_TO_TICKS(100));
+        int64_t rx_time_us = esp_timer_get_time();
         
         if (len > 0) {
+            int more = uart_read_bytes(NEXTION_UART_NUM, data + 1, NEXTION_BUF_SIZE - 2,
+                                       pdMS_TO_TICKS(NEXTION_FRAME_GAP_MS));
+            if (more > 0) {
+                len += more;
+            }
             data[len] = '\0';
             
             for (int i = 0; i < len; i++) {
                 if (data[i] == 0x65) {
-                    if (i + 6 < len && data[i + 3] == 0xFF && data[i + 4] == 0xFF && data[i + 5] == 0xFF) {
+                    if (i + 5 < len && data[i + 3] == 0xFF && data[i + 4] == 0xFF && data[i + 5] == 0xFF) {
                         nextion_event_t event = {0};
                         event.event = NEXTION_EVENT_TOUCH_PRESS;
                         event.page_id = data[i + 1];
                         event.component_id = data[i + 2];
+                        event.stage_us[NEXTION_STAGE_UART_RX] = rx_time_us;
                         
                         // Map component events to commands
                         if (event.page_id == 1) {
@@ -52,18 +85,47 @@ static void nextion_task(void* pvParameters)
                             }
                         }
                         
+                        nextion_latency_mark(&event, NEXTION_STAGE_DECODED);
+                        
+                        // A touch proves which page is on screen even if its sendme reply was lost
+                        if (event.page_id != nextion_get_visible_page()) {
+                            event.page_changed = nextion_handle_page_shown(event.page_id);
+                        }
+                        
                         if (event_callback) {
                             event_callback(&event);
                         }
                         
                         ESP_LOGI(TAG, "Touch event: Page %d, Component %d, Command %d", 
                                 event.page_id, event.component_id, event.command);
+                        i += 5;
+                    }
+                } else if (data[i] == NEXTION_EVENT_CURRENT_PAGE) {
+                    if (i + 4 < len && data[i + 2] == 0xFF && data[i + 3] == 0xFF && data[i + 4] == 0xFF) {
+                        nextion_event_t event = {0};
+                        event.event = NEXTION_EVENT_CURRENT_PAGE;
+                        event.page_id = data[i + 1];
+                        
+                        // sendme runs on every page load, so a reload of the same page
+                        // is back to its HMI defaults as well
+                        nextion_handle_page_shown(event.page_id);
+                        event.page_changed = true;
+                        
+                        if (event_callback) {
+                            event_callback(&event);
+                        }
+                        i += 4;
+                    }
+                } else if (data[i] == NEXTION_RET_TRANSPARENT_READY || data[i] == NEXTION_RET_TRANSPARENT_DONE) {
+                    if (i + 3 < len && data[i + 1] == 0xFF && data[i + 2] == 0xFF && data[i + 3] == 0xFF) {
+                        nextion_waveform_on_reply(data[i]);
+                        i += 3;
                     }
                 }
             }
         }
         
-        vTaskDelay(pdMS_TO_TICKS(10));
+        xSemaphoreGive(s_rx_lock);
     }
 }
 
@@ -87,6 +149,16 @@ esp_err_t nextion_hmi_init(void)
                                   UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
     ESP_ERROR_CHECK(uart_driver_install(NEXTION_UART_NUM, NEXTION_BUF_SIZE * 2, 0, 0, NULL, 0));
     
+    s_uart_lock = xSemaphoreCreateRecursiveMutex();
+    s_rx_lock = xSemaphoreCreateMutex();
+    if (!s_uart_lock || !s_rx_lock) {
+        uart_driver_delete(NEXTION_UART_NUM);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    ESP_ERROR_CHECK(nextion_binding_init());
+    ESP_ERROR_CHECK(nextion_latency_init());
+    
     vTaskDelay(pdMS_TO_TICKS(500));
     
     nextion_send_command("");
@@ -96,6 +168,11 @@ esp_err_t nextion_hmi_init(void)
     
     nextion_initialized = true;
     
+    ESP_ERROR_CHECK(nextion_waveform_init());
+    
+    // Ask which page is on screen; the 0x66 reply seeds the visible page
+    nextion_send_command("sendme");
+    
     ESP_LOGI(TAG, "NEXTION HMI initialized successfully (RX:%d, TX:%d)", NEXTION_RX_PIN, NEXTION_TX_PIN);
     
     return ESP_OK;
@@ -112,20 +189,87 @@ esp_err_t nextion_hmi_deinit(void)
         nextion_task_handle = NULL;
     }
     
+    nextion_waveform_deinit();
     uart_driver_delete(NEXTION_UART_NUM);
+    nextion_binding_deinit();
+    
+    if (s_uart_lock) {
+        vSemaphoreDelete(s_uart_lock);
+        s_uart_lock = NULL;
+    }
+    if (s_rx_lock) {
+        vSemaphoreDelete(s_rx_lock);
+        s_rx_lock = NULL;
+    }
     nextion_initialized = false;
     
     return ESP_OK;
 }
 
-esp_err_t nextion_send_command(const char* command)
+bool nextion_uart_lock(uint32_t timeout_ms)
+{
+    if (!s_uart_lock) {
+        return false;
+    }
+    TickType_t ticks = (timeout_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    return xSemaphoreTakeRecursive(s_uart_lock, ticks) == pdTRUE;
+}
+
+void nextion_uart_unlock(void)
+{
+    xSemaphoreGiveRecursive(s_uart_lock);
+}
+
+esp_err_t nextion_link_acquire(void)
 {
     if (!nextion_initialized) {
         return ESP_ERR_INVALID_STATE;
     }
     
+    // Refuse new writers first, then wait out a write or waveform transfer already in flight
+    s_link_exclusive = true;
+    nextion_uart_lock(UINT32_MAX);
+    xSemaphoreTake(s_rx_lock, portMAX_DELAY);
+    uart_flush_input(NEXTION_UART_NUM);
+    return ESP_OK;
+}
+
+void nextion_link_release(void)
+{
+    uart_flush_input(NEXTION_UART_NUM);
+    s_link_exclusive = false;
+    xSemaphoreGive(s_rx_lock);
+    nextion_uart_unlock();
+}
+
+bool nextion_tft_upload_in_progress(void)
+{
+    return s_link_exclusive;
+}
+
+esp_err_t nextion_uart_write(const char* data, size_t len)
+{
+    if (!nextion_initialized || s_link_exclusive) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    nextion_uart_lock(UINT32_MAX);
+    int written = uart_write_bytes(NEXTION_UART_NUM, data, len);
+    nextion_uart_unlock();
+    return (written == (int)len) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t nextion_send_command(const char* command)
+{
+    if (!nextion_initialized || s_link_exclusive) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    // Command and terminator must not be split by a waveform transfer
+    nextion_uart_lock(UINT32_MAX);
     int len = uart_write_bytes(NEXTION_UART_NUM, command, strlen(command));
-    uart_write_bytes(NEXTION_UART_NUM, "\xFF\xFF\xFF", 3);
+    uart_write_bytes(NEXTION_UART_NUM, NEXTION_TERMINATOR, NEXTION_TERMINATOR_LEN);
+    nextion_uart_unlock();
     
     ESP_LOGD(TAG, "명령 전송: %s", command);
     
@@ -150,7 +294,11 @@ esp_err_t nextion_change_page(uint8_t page_id)
 {
     char command[32];
     snprintf(command, sizeof(command), "page %d", page_id);
-    return nextion_send_command(command);
+    esp_err_t ret = nextion_send_command(command);
+    if (ret == ESP_OK) {
+        nextion_binding_on_page_change(page_id);
+    }
+    return ret;
 }
 
 esp_err_t nextion_set_event_callback(nextion_event_callback_t callback)
@@ -166,7 +314,8 @@ esp_err_t nextion_show_provisioning_message(const char* ssid, const char* passwo
 
 esp_err_t nextion_show_status(const char* status)
 {
-    return nextion_set_text("t0", status);
+    nextion_set_field(NEXTION_FIELD_SETUP_TITLE, status);
+    return nextion_render();
 }
 
 // Page 0 - Setup/Configuration Mode Functions
@@ -174,15 +323,15 @@ esp_err_t nextion_show_initial_setup_message(void)
 {
     esp_err_t ret;
     
-    ret = nextion_change_page(0);
+    ret = nextion_change_page(NEXTION_PAGE_SETUP);
     if (ret != ESP_OK) return ret;
     
     vTaskDelay(pdMS_TO_TICKS(100));
     
-    ret = nextion_set_text("t0", "BaegaePro need App Configutation");
-    if (ret != ESP_OK) return ret;
+    nextion_set_field(NEXTION_FIELD_SETUP_TITLE, "BaegaePro need App Configutation");
+    nextion_set_field(NEXTION_FIELD_SETUP_MESSAGE, "Please Open App");
     
-    ret = nextion_set_text("t1", "Please Open App");
+    ret = nextion_render();
     if (ret != ESP_OK) return ret;
     
     ESP_LOGI(TAG, "Initial setup message displayed");
@@ -194,17 +343,18 @@ esp_err_t nextion_show_provisioning_info(const char* ssid, const char* password)
 {
     esp_err_t ret;
     
-    ret = nextion_change_page(0);
+    ret = nextion_change_page(NEXTION_PAGE_SETUP);
     if (ret != ESP_OK) return ret;
     
     vTaskDelay(pdMS_TO_TICKS(100));
     
-    ret = nextion_set_text("t0", "Application Config Mode");
-    if (ret != ESP_OK) return ret;
-    
     char ap_info[128];
     snprintf(ap_info, sizeof(ap_info), "DEVICE ID : %s", ssid);
-    ret = nextion_set_text("t1", ap_info);
+    
+    nextion_set_field(NEXTION_FIELD_SETUP_TITLE, "Application Config Mode");
+    nextion_set_field(NEXTION_FIELD_SETUP_MESSAGE, ap_info);
+    
+    ret = nextion_render();
     if (ret != ESP_OK) return ret;
     
     ESP_LOGI(TAG, "Provisioning info displayed: %s", ssid);
@@ -216,15 +366,15 @@ esp_err_t nextion_show_setup_status(const char* status)
 {
     esp_err_t ret;
     
-    ret = nextion_change_page(0);
+    ret = nextion_change_page(NEXTION_PAGE_SETUP);
     if (ret != ESP_OK) return ret;
     
     vTaskDelay(pdMS_TO_TICKS(100));
     
-    ret = nextion_set_text("t0", status);
-    if (ret != ESP_OK) return ret;
+    nextion_set_field(NEXTION_FIELD_SETUP_TITLE, status);
+    nextion_set_field(NEXTION_FIELD_SETUP_MESSAGE, "Please wait...");
     
-    ret = nextion_set_text("t1", "Please wait...");
+    ret = nextion_render();
     if (ret != ESP_OK) return ret;
     
     ESP_LOGI(TAG, "Setup status: %s", status);
@@ -233,61 +383,29 @@ esp_err_t nextion_show_setup_status(const char* status)
 }
 
 // Page 1 - Home Mode Functions
+// Home fields are deferred while another page is visible and flushed when page 1 is shown
 esp_err_t nextion_show_home_data(const char* temperature, const char* weather, const char* sleep_score, const char* noise_level, const char* alarm_time)
 {
     esp_err_t ret;
     
-    ret = nextion_change_page(1);
-    if (ret != ESP_OK) return ret;
-    
-    vTaskDelay(pdMS_TO_TICKS(100));
-    
     // Fixed dummy data for home display
-    ret = nextion_set_text("t0", "13°C");
-    if (ret != ESP_OK) return ret;
-    
-    ret = nextion_set_text("t1", "--");
-    if (ret != ESP_OK) return ret;
-    
-    ret = nextion_set_text("t2", "--");
-    if (ret != ESP_OK) return ret;
-    
-    ret = nextion_set_text("t3", "--");
-    if (ret != ESP_OK) return ret;
+    nextion_set_field(NEXTION_FIELD_HOME_TEMPERATURE, "13");
+    nextion_set_field(NEXTION_FIELD_HOME_WEATHER, "--");
+    nextion_set_field(NEXTION_FIELD_HOME_SLEEP_SCORE, "--");
+    nextion_set_field(NEXTION_FIELD_HOME_NOISE_LEVEL, "--");
+    nextion_set_field(NEXTION_FIELD_HOME_ALARM, "--");
     
-    ret = nextion_set_text("t4", "--");
-    if (ret != ESP_OK) return ret;
-    
-    // Commented out original dynamic content
+    // Original dynamic content - the binding table formats temperature as "%s°C"
     /*
-    // t0: Temperature display
-    char temp_display[64];
-    snprintf(temp_display, sizeof(temp_display), "%s°C", temperature);
-    ret = nextion_set_text("t0", temp_display);
-    if (ret != ESP_OK) return ret;
-    
-    // t1: Weather info
-    ret = nextion_set_text("t1", weather);
-    if (ret != ESP_OK) return ret;
-    
-    // t2: Sleep score
-    char score_display[64];
-    snprintf(score_display, sizeof(score_display), "Sleep: %s points", sleep_score);
-    ret = nextion_set_text("t2", score_display);
-    if (ret != ESP_OK) return ret;
-    
-    // t3: Environment info
-    char env_display[64];
-    snprintf(env_display, sizeof(env_display), "Noise: %sdB", noise_level);
-    ret = nextion_set_text("t3", env_display);
-    if (ret != ESP_OK) return ret;
+    nextion_set_field(NEXTION_FIELD_HOME_TEMPERATURE, temperature);
+    nextion_set_field(NEXTION_FIELD_HOME_WEATHER, weather);
+    nextion_set_field(NEXTION_FIELD_HOME_SLEEP_SCORE, sleep_score);
+    nextion_set_field(NEXTION_FIELD_HOME_NOISE_LEVEL, noise_level);
+    nextion_set_field(NEXTION_FIELD_HOME_ALARM, alarm_time);
+    */
     
-    // t4: Alarm time
-    char alarm_display[64];
-    snprintf(alarm_display, sizeof(alarm_display), "Alarm: %s", alarm_time);
-    ret = nextion_set_text("t4", alarm_display);
+    ret = nextion_render();
     if (ret != ESP_OK) return ret;
-    */
     
     ESP_LOGI(TAG, "Home data updated with dummy values: t0=13°C, t1-t4=--");
     
@@ -296,7 +414,8 @@ esp_err_t nextion_show_home_data(const char* temperature, const char* weather, c
 
 esp_err_t nextion_show_fota_status(const char* status)
 {
-    esp_err_t ret = nextion_set_text("t49", status);
+    nextion_set_field(NEXTION_FIELD_HOME_FOTA_STATUS, status);
+    esp_err_t ret = nextion_render();
     if (ret == ESP_OK) {
         ESP_LOGI(TAG, "FOTA status displayed: %s", status);
     }
@@ -305,74 +424,19 @@ esp_err_t nextion_show_fota_status(const char* status)
 
 esp_err_t nextion_clear_fota_status(void)
 {
-    esp_err_t ret = nextion_set_text("t49", "");
+    nextion_set_field(NEXTION_FIELD_HOME_FOTA_STATUS, "");
+    esp_err_t ret = nextion_render();
     if (ret == ESP_OK) {
         ESP_LOGI(TAG, "FOTA status cleared");
     }
     return ret;
 }
 
-esp_err_t nextion_show_heartbeat_data_detailed(const char* current_time_kr, const char* alarm_time_display, float temperature, float humidity)
+// Clock and alarm fields (t5, t6, t9) are rendered every minute from local time by the application
+esp_err_t nextion_show_heartbeat_data_detailed(float temperature, float humidity)
 {
     esp_err_t ret;
     
-    ret = nextion_change_page(1);
-    if (ret != ESP_OK) return ret;
-    
-    vTaskDelay(pdMS_TO_TICKS(100));
-    
-    // Extract time components from current_time_kr
-    // Expected format: "2025년 8월 29일 오후 2:30" -> extract "14:30"
-    char time_str[16] = "00:00";
-    if (current_time_kr) {
-        // Look for time pattern like "오전 7:20" or "오후 2:30"
-        const char* time_part = strstr(current_time_kr, "오전 ");
-        if (!time_part) {
-            time_part = strstr(current_time_kr, "오후 ");
-        }
-        if (time_part) {
-            // Skip "오전 " or "오후 " (3 bytes each in UTF-8)
-            time_part += 6;
-            int hour, minute;
-            if (sscanf(time_part, "%d:%d", &hour, &minute) == 2) {
-                // Convert to 24-hour format if needed
-                if (strstr(current_time_kr, "오후 ") && hour != 12) {
-                    hour += 12;
-                } else if (strstr(current_time_kr, "오전 ") && hour == 12) {
-                    hour = 0;
-                }
-                snprintf(time_str, sizeof(time_str), "%02d:%02d", hour, minute);
-            }
-        }
-    }
-    
-    // Extract alarm time components
-    // Expected format: "오전 7:20" -> extract hour and minute separately
-    char alarm_hour[8] = "00";
-    char alarm_minute[8] = "00";
-    if (alarm_time_display) {
-        const char* alarm_part = strstr(alarm_time_display, "오전 ");
-        bool is_pm = false;
-        if (!alarm_part) {
-            alarm_part = strstr(alarm_time_display, "오후 ");
-            is_pm = true;
-        }
-        if (alarm_part) {
-            alarm_part += 6; // Skip "오전 " or "오후 "
-            int hour, minute;
-            if (sscanf(alarm_part, "%d:%d", &hour, &minute) == 2) {
-                // Convert to 24-hour format
-                if (is_pm && hour != 12) {
-                    hour += 12;
-                } else if (!is_pm && hour == 12) {
-                    hour = 0;
-                }
-                snprintf(alarm_hour, sizeof(alarm_hour), "%d", hour);
-                snprintf(alarm_minute, sizeof(alarm_minute), "%02d", minute);
-            }
-        }
-    }
-    
     // Format temperature and humidity as plain numbers
     char temp_str[16];
     char humidity_str[16];
@@ -380,45 +444,19 @@ esp_err_t nextion_show_heartbeat_data_detailed(const char* current_time_kr, cons
     snprintf(humidity_str, sizeof(humidity_str), "%.0f", humidity);
     
     // Fixed dummy data for heartbeat display
-    ret = nextion_set_text("t5", "1:24");
-    if (ret != ESP_OK) return ret;
-    
-    ret = nextion_set_text("t6", "4");
-    if (ret != ESP_OK) return ret;
+    nextion_set_field(NEXTION_FIELD_HOME_ROOM_TEMP, "--");
+    nextion_set_field(NEXTION_FIELD_HOME_ROOM_HUMIDITY, "--");
     
-    ret = nextion_set_text("t7", "--");
-    if (ret != ESP_OK) return ret;
-    
-    ret = nextion_set_text("t8", "--");
-    if (ret != ESP_OK) return ret;
-    
-    ret = nextion_set_text("t9", "24");
-    if (ret != ESP_OK) return ret;
-    
-    // Commented out original dynamic content
+    // Original dynamic content
     /*
-    // t5: Current time (HH:MM format)
-    ret = nextion_set_text("t5", time_str);
-    if (ret != ESP_OK) return ret;
-    
-    // t6: Alarm hour
-    ret = nextion_set_text("t6", alarm_hour);
-    if (ret != ESP_OK) return ret;
-    
-    // t7: Temperature (plain number)
-    ret = nextion_set_text("t7", temp_str);
-    if (ret != ESP_OK) return ret;
-    
-    // t8: Humidity (plain number)
-    ret = nextion_set_text("t8", humidity_str);
-    if (ret != ESP_OK) return ret;
+    nextion_set_field(NEXTION_FIELD_HOME_ROOM_TEMP, temp_str);
+    nextion_set_field(NEXTION_FIELD_HOME_ROOM_HUMIDITY, humidity_str);
+    */
     
-    // t9: Alarm minute (if available)
-    ret = nextion_set_text("t9", alarm_minute);
+    ret = nextion_render();
     if (ret != ESP_OK) return ret;
-    */
     
-    ESP_LOGI(TAG, "Heartbeat data updated with dummy values: t5=1:24, t6=4, t7-t8=--, t9=24");
+    ESP_LOGI(TAG, "Heartbeat data updated with dummy values: t7-t8=--");
     
     return ESP_OK;
 }
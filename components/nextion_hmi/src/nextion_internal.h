@@ -0,0 +1,39 @@
+#ifndef NEXTION_INTERNAL_H
+#define NEXTION_INTERNAL_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Shared between the nextion_hmi sources only - not part of the public API
+
+#define NEXTION_TERMINATOR "\xFF\xFF\xFF"
+#define NEXTION_TERMINATOR_LEN 3
+
+// Return codes the panel sends around an addt transparent transfer
+#define NEXTION_RET_TRANSPARENT_DONE 0xFD
+#define NEXTION_RET_TRANSPARENT_READY 0xFE
+
+esp_err_t nextion_uart_write(const char* data, size_t len);
+
+// Holds the TX side across several writes, e.g. an addt command and its raw data.
+// nextion_uart_write takes the same recursive lock, so it may be called while held.
+bool nextion_uart_lock(uint32_t timeout_ms);
+void nextion_uart_unlock(void);
+
+// Hands the whole link (TX and RX) to the caller for a TFT upload
+esp_err_t nextion_link_acquire(void);
+void nextion_link_release(void);
+
+esp_err_t nextion_binding_init(void);
+void nextion_binding_deinit(void);
+bool nextion_binding_on_page_change(uint8_t page_id);    // true if the visible page moved
+
+esp_err_t nextion_latency_init(void);
+
+esp_err_t nextion_waveform_init(void);
+void nextion_waveform_deinit(void);
+void nextion_waveform_on_reply(uint8_t code);
+
+#endif
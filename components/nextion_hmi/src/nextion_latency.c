@@ -0,0 +1,177 @@
+#include "nextion_hmi.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char* TAG = "NEXTION_LATENCY";
+
+typedef struct {
+    uint32_t total_us[NEXTION_LATENCY_SAMPLES];
+    uint32_t stage_us[NEXTION_LATENCY_SAMPLES][NEXTION_STAGE_MAX - 1];
+    uint32_t next;
+    uint32_t count;
+    uint32_t over_budget;
+} latency_window_t;
+
+static latency_window_t s_windows[NEXTION_CMD_MAX];
+static SemaphoreHandle_t s_lock = NULL;
+
+static const char* command_name(nextion_command_type_t command)
+{
+    switch (command) {
+        case NEXTION_CMD_GO_SETTINGS: return "GO_SETTINGS";
+        case NEXTION_CMD_GO_WIFI_LIST: return "GO_WIFI_LIST";
+        case NEXTION_CMD_REFRESH_DATA: return "REFRESH_DATA";
+        case NEXTION_CMD_FACTORY_RESET: return "FACTORY_RESET";
+        default: return "NONE";
+    }
+}
+
+esp_err_t nextion_latency_init(void)
+{
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    
+    memset(s_windows, 0, sizeof(s_windows));
+    return ESP_OK;
+}
+
+static uint32_t percentile(const uint32_t* values, uint32_t count, uint32_t pct)
+{
+    uint32_t sorted[NEXTION_LATENCY_SAMPLES];
+    memcpy(sorted, values, count * sizeof(uint32_t));
+    
+    for (uint32_t i = 1; i < count; i++) {
+        uint32_t v = sorted[i];
+        uint32_t j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    
+    uint32_t idx = (count * pct) / 100;
+    if (idx >= count) {
+        idx = count - 1;
+    }
+    return sorted[idx];
+}
+
+void nextion_latency_mark(nextion_event_t* event, nextion_latency_stage_t stage)
+{
+    if (event && stage < NEXTION_STAGE_MAX) {
+        event->stage_us[stage] = esp_timer_get_time();
+    }
+}
+
+void nextion_latency_commit(const nextion_event_t* event)
+{
+    if (!event || event->command >= NEXTION_CMD_MAX || !s_lock) {
+        return;
+    }
+    
+    int64_t start = event->stage_us[NEXTION_STAGE_UART_RX];
+    int64_t end = event->stage_us[NEXTION_STAGE_ACTION_DONE];
+    if (start == 0 || end < start) {
+        return;
+    }
+    
+    uint32_t total = (uint32_t)(end - start);
+    
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    
+    latency_window_t* w = &s_windows[event->command];
+    w->total_us[w->next] = total;
+    
+    // Stages that were not marked are attributed to the next stage that was
+    int64_t prev = start;
+    for (int stage = NEXTION_STAGE_DECODED; stage < NEXTION_STAGE_MAX; stage++) {
+        int64_t t = event->stage_us[stage];
+        if (t >= prev) {
+            w->stage_us[w->next][stage - 1] = (uint32_t)(t - prev);
+            prev = t;
+        } else {
+            w->stage_us[w->next][stage - 1] = 0;
+        }
+    }
+    
+    w->next = (w->next + 1) % NEXTION_LATENCY_SAMPLES;
+    if (w->count < NEXTION_LATENCY_SAMPLES) {
+        w->count++;
+    }
+    
+    bool over = total > NEXTION_LATENCY_BUDGET_MS * 1000;
+    if (over) {
+        w->over_budget++;
+    }
+    
+    xSemaphoreGive(s_lock);
+    
+    if (over) {
+        ESP_LOGW(TAG, "%s took %lu ms (budget %d ms)", command_name(event->command),
+                 (unsigned long)(total / 1000), NEXTION_LATENCY_BUDGET_MS);
+    } else {
+        ESP_LOGD(TAG, "%s took %lu ms", command_name(event->command), (unsigned long)(total / 1000));
+    }
+}
+
+esp_err_t nextion_latency_get_stats(nextion_command_type_t command, nextion_latency_stats_t* stats)
+{
+    if (command >= NEXTION_CMD_MAX || !stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    memset(stats, 0, sizeof(nextion_latency_stats_t));
+    
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    
+    const latency_window_t* w = &s_windows[command];
+    stats->count = w->count;
+    stats->over_budget = w->over_budget;
+    
+    if (w->count > 0) {
+        stats->total_p50_ms = percentile(w->total_us, w->count, 50) / 1000;
+        stats->total_p90_ms = percentile(w->total_us, w->count, 90) / 1000;
+        stats->total_p99_ms = percentile(w->total_us, w->count, 99) / 1000;
+        stats->total_max_ms = percentile(w->total_us, w->count, 100) / 1000;
+        
+        for (int stage = 0; stage < NEXTION_STAGE_MAX - 1; stage++) {
+            uint32_t column[NEXTION_LATENCY_SAMPLES];
+            for (uint32_t i = 0; i < w->count; i++) {
+                column[i] = w->stage_us[i][stage];
+            }
+            stats->stage_p50_ms[stage] = percentile(column, w->count, 50) / 1000;
+        }
+    }
+    
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+void nextion_latency_log_summary(void)
+{
+    for (int command = NEXTION_CMD_NONE + 1; command < NEXTION_CMD_MAX; command++) {
+        nextion_latency_stats_t stats;
+        if (nextion_latency_get_stats(command, &stats) != ESP_OK || stats.count == 0) {
+            continue;
+        }
+        
+        ESP_LOGI(TAG, "%s n=%lu p50=%lu p90=%lu p99=%lu max=%lu ms (decode %lu, callback %lu, queue %lu, work %lu) over budget: %lu",
+                 command_name(command), (unsigned long)stats.count,
+                 (unsigned long)stats.total_p50_ms, (unsigned long)stats.total_p90_ms,
+                 (unsigned long)stats.total_p99_ms, (unsigned long)stats.total_max_ms,
+                 (unsigned long)stats.stage_p50_ms[0], (unsigned long)stats.stage_p50_ms[1],
+                 (unsigned long)stats.stage_p50_ms[2], (unsigned long)stats.stage_p50_ms[3],
+                 (unsigned long)stats.over_budget);
+    }
+}
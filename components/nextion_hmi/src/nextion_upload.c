@@ -0,0 +1,163 @@
+#include "nextion_hmi.h"
+#include "nextion_internal.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char* TAG = "NEXTION_TFT";
+
+#define TFT_ACK_CHUNK 0x05
+#define TFT_ACK_SKIP 0x08       // Followed by a little-endian offset: the panel already has the file up to it
+
+// Static: the upload runs in the caller's task, which need not have 4 KB of stack to spare
+static uint8_t s_chunk[NEXTION_TFT_CHUNK_SIZE];
+
+static esp_err_t read_exact(uint8_t* buf, size_t len, uint32_t timeout_ms)
+{
+    size_t got = 0;
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(timeout_ms);
+    
+    while (got < len) {
+        TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(deadline - now) <= 0) {
+            return ESP_ERR_TIMEOUT;
+        }
+        int n = uart_read_bytes(NEXTION_UART_NUM, buf + got, len - got, deadline - now);
+        if (n < 0) {
+            return ESP_FAIL;
+        }
+        got += n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t wait_ack(uint32_t timeout_ms, uint32_t* skip_to)
+{
+    uint8_t code;
+    esp_err_t ret = read_exact(&code, 1, timeout_ms);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    *skip_to = 0;
+    if (code == TFT_ACK_CHUNK) {
+        return ESP_OK;
+    }
+    if (code == TFT_ACK_SKIP) {
+        uint8_t offset[4];
+        ret = read_exact(offset, sizeof(offset), timeout_ms);
+        if (ret == ESP_OK) {
+            *skip_to = offset[0] | (offset[1] << 8) | (offset[2] << 16) | ((uint32_t)offset[3] << 24);
+        }
+        return ret;
+    }
+    
+    ESP_LOGW(TAG, "Unexpected reply 0x%02x", code);
+    return ESP_ERR_INVALID_RESPONSE;
+}
+
+static esp_err_t upload_session(const esp_partition_t* partition, uint32_t tft_size,
+                                nextion_tft_progress_callback_t progress, uint32_t* acked)
+{
+    char command[48];
+    int len = snprintf(command, sizeof(command), "whmi-wris %lu,%d,1",
+                       (unsigned long)tft_size, NEXTION_TFT_UPLOAD_BAUD);
+    
+    // Empty instruction first so any half-received command on the panel is terminated
+    uart_write_bytes(NEXTION_UART_NUM, NEXTION_TERMINATOR, NEXTION_TERMINATOR_LEN);
+    uart_write_bytes(NEXTION_UART_NUM, command, len);
+    uart_write_bytes(NEXTION_UART_NUM, NEXTION_TERMINATOR, NEXTION_TERMINATOR_LEN);
+    uart_wait_tx_done(NEXTION_UART_NUM, pdMS_TO_TICKS(100));
+    
+    // The panel switches rate after the command and announces readiness at the new rate
+    uart_set_baudrate(NEXTION_UART_NUM, NEXTION_TFT_UPLOAD_BAUD);
+    
+    uint32_t skip_to;
+    esp_err_t ret = wait_ack(NEXTION_TFT_ACK_TIMEOUT_MS, &skip_to);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Panel did not enter download mode: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    uint32_t offset = 0;
+    while (offset < tft_size) {
+        size_t n = (tft_size - offset < NEXTION_TFT_CHUNK_SIZE) ? tft_size - offset : NEXTION_TFT_CHUNK_SIZE;
+    
+        ret = esp_partition_read(partition, offset, s_chunk, n);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Flash read at 0x%lx failed: %s", (unsigned long)offset, esp_err_to_name(ret));
+            return ret;
+        }
+    
+        if (uart_write_bytes(NEXTION_UART_NUM, s_chunk, n) != (int)n) {
+            return ESP_FAIL;
+        }
+    
+        ret = wait_ack(NEXTION_TFT_ACK_TIMEOUT_MS, &skip_to);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "No ack for chunk at 0x%lx: %s", (unsigned long)offset, esp_err_to_name(ret));
+            return ret;
+        }
+    
+        if (skip_to > offset && skip_to <= tft_size) {
+            ESP_LOGI(TAG, "Panel already has %lu bytes, resuming there", (unsigned long)skip_to);
+            offset = skip_to;
+        } else {
+            offset += n;
+        }
+    
+        *acked = offset;
+        if (progress) {
+            progress(offset, tft_size);
+        }
+    }
+    
+    return ESP_OK;
+}
+
+esp_err_t nextion_tft_upload(const esp_partition_t* partition, uint32_t tft_size,
+                             nextion_tft_progress_callback_t progress)
+{
+    if (!partition || tft_size == 0 || tft_size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    esp_err_t ret = nextion_link_acquire();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    ESP_LOGI(TAG, "Uploading %lu byte TFT from '%s' at %d baud",
+             (unsigned long)tft_size, partition->label, NEXTION_TFT_UPLOAD_BAUD);
+    
+    uint32_t acked = 0;
+    for (int attempt = 1; attempt <= NEXTION_TFT_MAX_ATTEMPTS; attempt++) {
+        ret = upload_session(partition, tft_size, progress, &acked);
+        uart_set_baudrate(NEXTION_UART_NUM, NEXTION_BAUD_RATE);
+        if (ret == ESP_OK) {
+            break;
+        }
+    
+        ESP_LOGW(TAG, "Upload attempt %d/%d stopped at %lu of %lu bytes", attempt,
+                 NEXTION_TFT_MAX_ATTEMPTS, (unsigned long)acked, (unsigned long)tft_size);
+        if (attempt < NEXTION_TFT_MAX_ATTEMPTS) {
+            vTaskDelay(pdMS_TO_TICKS(NEXTION_TFT_RETRY_DELAY_MS));
+        }
+    }
+    
+    nextion_link_release();
+    
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "TFT upload failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    // The panel reboots into the new UI on its default page; ask which one once it is up
+    ESP_LOGI(TAG, "TFT upload complete");
+    vTaskDelay(pdMS_TO_TICKS(2000));
+    nextion_send_command("sendme");
+    
+    return ESP_OK;
+}
@@ -0,0 +1,387 @@
+#include "nextion_hmi.h"
+#include "nextion_internal.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* TAG = "NEXTION_WAVE";
+
+// Both traces share one two-channel waveform on the home page. Object id 50 is reserved for it
+// until the HMI project gains the component; nothing is sent before a producer pushes samples.
+static const nextion_waveform_binding_t s_waveforms[] = {
+    { NEXTION_WAVE_HEART_RATE, NEXTION_PAGE_HOME, 50, 0, 100, 4, 40, 180  },
+    { NEXTION_WAVE_PRESSURE,   NEXTION_PAGE_HOME, 50, 1, 100, 4, 0,  4095 },
+};
+
+#define WAVEFORM_COUNT (sizeof(s_waveforms) / sizeof(s_waveforms[0]))
+#define RING_MASK (NEXTION_WAVEFORM_RING_SIZE - 1)
+
+// Wire bytes per second plotting may spend, and the most it may save up (one full addt)
+#define WAVE_RATE_BYTES_PER_SEC (NEXTION_BAUD_RATE / 10 * NEXTION_WAVEFORM_UART_SHARE_PCT / 100)
+#define WAVE_BUCKET_CAPACITY (NEXTION_WAVEFORM_ADDT_MAX + 32)
+#define ADDT_FAILURE_LIMIT 3
+#define ADDT_RETRY_MIN_MS (30 * 1000)          // add-only period after addt stops being acknowledged,
+#define ADDT_RETRY_MAX_MS (10 * 60 * 1000)     // doubled on every failed retry up to this
+#define WAVE_TASK_STACK_SIZE 3072
+
+typedef struct {
+    uint8_t points[NEXTION_WAVEFORM_RING_SIZE];
+    uint32_t head;                  // Points written since boot
+    uint32_t sent;                  // Points handed to the panel since boot
+    int64_t acc_sum;
+    uint8_t acc_count;
+    uint32_t dropped;
+} wave_ring_t;
+
+// Rings and task only exist once a producer pushes its first sample
+static wave_ring_t* s_rings = NULL;
+static portMUX_TYPE s_ring_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static SemaphoreHandle_t s_start_lock = NULL;
+static SemaphoreHandle_t s_ready = NULL;
+static SemaphoreHandle_t s_done = NULL;
+static TaskHandle_t s_task = NULL;
+
+static int64_t s_tokens = WAVE_BUCKET_CAPACITY;
+static int64_t s_refill_us = 0;
+static int s_addt_failures = 0;
+static uint32_t s_addt_backoff_ms = ADDT_RETRY_MIN_MS;
+static int64_t s_addt_retry_us = 0;     // While addt is suspended: when to try it again
+
+static void waveform_task(void* pvParameters);
+
+static int find_waveform(nextion_wave_t wave)
+{
+    for (size_t i = 0; i < WAVEFORM_COUNT; i++) {
+        if (s_waveforms[i].wave == wave) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint8_t scale_point(const nextion_waveform_binding_t* wf, int32_t value)
+{
+    if (value <= wf->min_value) {
+        return 0;
+    }
+    if (value >= wf->max_value) {
+        return wf->height;
+    }
+    return (uint8_t)((int64_t)(value - wf->min_value) * wf->height / (wf->max_value - wf->min_value));
+}
+
+static esp_err_t start_streaming(void)
+{
+    if (!s_start_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake(s_start_lock, portMAX_DELAY);
+    if (!s_task) {
+        s_rings = calloc(WAVEFORM_COUNT, sizeof(wave_ring_t));
+        if (!s_rings) {
+            ret = ESP_ERR_NO_MEM;
+        } else if (xTaskCreate(waveform_task, "nextion_wave", WAVE_TASK_STACK_SIZE, NULL, 4, &s_task) != pdPASS) {
+            free(s_rings);
+            s_rings = NULL;
+            ret = ESP_ERR_NO_MEM;
+        } else {
+            ESP_LOGI(TAG, "Waveform streaming started (%d B/s of UART budget)", WAVE_RATE_BYTES_PER_SEC);
+        }
+    }
+    xSemaphoreGive(s_start_lock);
+    return ret;
+}
+
+esp_err_t nextion_waveform_push_sample(nextion_wave_t wave, int32_t value)
+{
+    int idx = find_waveform(wave);
+    if (idx < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_task) {
+        esp_err_t ret = start_streaming();
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    
+    const nextion_waveform_binding_t* wf = &s_waveforms[idx];
+    wave_ring_t* ring = &s_rings[idx];
+    
+    portENTER_CRITICAL(&s_ring_mux);
+    ring->acc_sum += value;
+    ring->acc_count++;
+    if (ring->acc_count >= wf->decimation) {
+        int32_t average = (int32_t)(ring->acc_sum / ring->acc_count);
+        ring->acc_sum = 0;
+        ring->acc_count = 0;
+        
+        ring->points[ring->head & RING_MASK] = scale_point(wf, average);
+        ring->head++;
+        // Oldest unsent points are overwritten while the page is hidden or the link is busy
+        if (ring->head - ring->sent > NEXTION_WAVEFORM_RING_SIZE) {
+            ring->dropped += ring->head - ring->sent - NEXTION_WAVEFORM_RING_SIZE;
+            ring->sent = ring->head - NEXTION_WAVEFORM_RING_SIZE;
+        }
+    }
+    portEXIT_CRITICAL(&s_ring_mux);
+    
+    return ESP_OK;
+}
+
+esp_err_t nextion_waveform_clear(nextion_wave_t wave)
+{
+    int idx = find_waveform(wave);
+    if (idx < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_task) {
+        return ESP_OK;      // Nothing was ever plotted
+    }
+    
+    wave_ring_t* ring = &s_rings[idx];
+    portENTER_CRITICAL(&s_ring_mux);
+    ring->sent = ring->head;
+    ring->acc_sum = 0;
+    ring->acc_count = 0;
+    portEXIT_CRITICAL(&s_ring_mux);
+    
+    if (s_waveforms[idx].page_id != nextion_get_visible_page()) {
+        return ESP_OK;
+    }
+    
+    char command[32];
+    snprintf(command, sizeof(command), "cle %d,%d", s_waveforms[idx].component_id, s_waveforms[idx].channel);
+    return nextion_send_command(command);
+}
+
+void nextion_waveform_on_reply(uint8_t code)
+{
+    if (code == NEXTION_RET_TRANSPARENT_READY && s_ready) {
+        xSemaphoreGive(s_ready);
+    } else if (code == NEXTION_RET_TRANSPARENT_DONE && s_done) {
+        xSemaphoreGive(s_done);
+    }
+}
+
+static void refill_tokens(void)
+{
+    int64_t now = esp_timer_get_time();
+    s_tokens += (now - s_refill_us) * WAVE_RATE_BYTES_PER_SEC / 1000000;
+    if (s_tokens > WAVE_BUCKET_CAPACITY) {
+        s_tokens = WAVE_BUCKET_CAPACITY;
+    }
+    s_refill_us = now;
+}
+
+// Copies up to max_points unsent points without consuming them
+static size_t peek_points(int idx, uint8_t* out, size_t max_points)
+{
+    wave_ring_t* ring = &s_rings[idx];
+    
+    portENTER_CRITICAL(&s_ring_mux);
+    uint32_t pending = ring->head - ring->sent;
+    size_t count = (pending < max_points) ? pending : max_points;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = ring->points[(ring->sent + i) & RING_MASK];
+    }
+    portEXIT_CRITICAL(&s_ring_mux);
+    
+    return count;
+}
+
+static void consume_points(int idx, size_t count)
+{
+    portENTER_CRITICAL(&s_ring_mux);
+    // A push may have overwritten the points meanwhile and already moved the cursor past them
+    uint32_t pending = s_rings[idx].head - s_rings[idx].sent;
+    s_rings[idx].sent += (count < pending) ? count : pending;
+    portEXIT_CRITICAL(&s_ring_mux);
+}
+
+static esp_err_t send_add(const nextion_waveform_binding_t* wf, uint8_t point, int* cost)
+{
+    char command[32];
+    int len = snprintf(command, sizeof(command), "add %d,%d,%d", wf->component_id, wf->channel, point);
+    *cost = len + NEXTION_TERMINATOR_LEN;
+    if (*cost > s_tokens) {
+        return ESP_ERR_NOT_FINISHED;
+    }
+    
+    memcpy(command + len, NEXTION_TERMINATOR, NEXTION_TERMINATOR_LEN);
+    return nextion_uart_write(command, *cost);
+}
+
+// addt: the panel answers 0xFE when it is ready for the raw bytes and 0xFD once they are plotted.
+// Nothing else may be written in between, so the TX lock is held for the whole exchange.
+static esp_err_t send_addt(const nextion_waveform_binding_t* wf, const uint8_t* points, size_t count)
+{
+    char command[32];
+    int len = snprintf(command, sizeof(command), "addt %d,%d,%d", wf->component_id, wf->channel, (int)count);
+    memcpy(command + len, NEXTION_TERMINATOR, NEXTION_TERMINATOR_LEN);
+    
+    if (!nextion_uart_lock(NEXTION_WAVEFORM_FLUSH_MS)) {
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    xSemaphoreTake(s_ready, 0);
+    xSemaphoreTake(s_done, 0);
+    
+    esp_err_t ret = nextion_uart_write(command, len + NEXTION_TERMINATOR_LEN);
+    if (ret != ESP_OK) {
+        nextion_uart_unlock();
+        return ret;
+    }
+    
+    // Send the data even if the ready reply was missed: a panel left waiting in transparent
+    // mode would swallow the next commands, while stray bytes outside it cost one invalid instruction
+    bool ready = xSemaphoreTake(s_ready, pdMS_TO_TICKS(NEXTION_WAVEFORM_HANDSHAKE_MS)) == pdTRUE;
+    ret = nextion_uart_write((const char*)points, count);
+    
+    uint32_t wire_ms = (len + NEXTION_TERMINATOR_LEN + count) * 10 * 1000 / NEXTION_BAUD_RATE;
+    bool done = xSemaphoreTake(s_done, pdMS_TO_TICKS(wire_ms + NEXTION_WAVEFORM_HANDSHAKE_MS)) == pdTRUE;
+    
+    nextion_uart_unlock();
+    
+    if (ret == ESP_OK && (!ready || !done)) {
+        s_addt_failures++;
+        ESP_LOGW(TAG, "addt handshake incomplete (ready=%d, done=%d)", ready, done);
+        // A panel busy with a page load or a TFT upload misses handshakes too, so addt is
+        // suspended for a while rather than for good
+        if (s_addt_failures >= ADDT_FAILURE_LIMIT) {
+            ESP_LOGW(TAG, "Panel does not acknowledge addt - using add, retrying in %lu s",
+                     (unsigned long)(s_addt_backoff_ms / 1000));
+            s_addt_retry_us = esp_timer_get_time() + (int64_t)s_addt_backoff_ms * 1000;
+            s_addt_backoff_ms = (s_addt_backoff_ms * 2 < ADDT_RETRY_MAX_MS) ? s_addt_backoff_ms * 2 : ADDT_RETRY_MAX_MS;
+        }
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    
+    s_addt_failures = 0;
+    s_addt_backoff_ms = ADDT_RETRY_MIN_MS;
+    return ret;
+}
+
+static bool addt_usable(void)
+{
+    return s_addt_failures < ADDT_FAILURE_LIMIT || esp_timer_get_time() >= s_addt_retry_us;
+}
+
+static void flush_waveform(int idx)
+{
+    const nextion_waveform_binding_t* wf = &s_waveforms[idx];
+    uint8_t points[NEXTION_WAVEFORM_ADDT_MAX];
+    
+    size_t count = peek_points(idx, points, NEXTION_WAVEFORM_ADDT_MAX);
+    if (count == 0) {
+        return;
+    }
+    
+    if (count >= NEXTION_WAVEFORM_ADDT_MIN && addt_usable()) {
+        // Shrink the transfer to what the bucket holds; wait for more tokens rather than
+        // falling back to the far more expensive per-point add
+        int64_t overhead = snprintf(NULL, 0, "addt %d,%d,%d", wf->component_id, wf->channel,
+                                    NEXTION_WAVEFORM_ADDT_MAX) + NEXTION_TERMINATOR_LEN;
+        if (s_tokens - overhead < (int64_t)count) {
+            count = (s_tokens > overhead) ? (size_t)(s_tokens - overhead) : 0;
+        }
+        if (count < NEXTION_WAVEFORM_ADDT_MIN) {
+            return;
+        }
+        
+        esp_err_t ret = send_addt(wf, points, count);
+        if (ret == ESP_ERR_TIMEOUT) {
+            return;
+        }
+        s_tokens -= overhead + count;
+        // Points of a failed transfer are not resent - a late trace is worse than a gap
+        consume_points(idx, count);
+        return;
+    }
+    
+    size_t sent = 0;
+    while (sent < count) {
+        int cost;
+        if (send_add(wf, points[sent], &cost) != ESP_OK) {
+            break;
+        }
+        s_tokens -= cost;
+        sent++;
+    }
+    consume_points(idx, sent);
+}
+
+static void waveform_task(void* pvParameters)
+{
+    uint32_t last_dropped[WAVEFORM_COUNT] = {0};
+    
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(NEXTION_WAVEFORM_FLUSH_MS));
+        refill_tokens();
+        
+        uint8_t page = nextion_get_visible_page();
+        for (size_t i = 0; i < WAVEFORM_COUNT; i++) {
+            if (s_waveforms[i].page_id == page) {
+                flush_waveform(i);
+            }
+            
+            if (s_rings[i].dropped != last_dropped[i]) {
+                ESP_LOGD(TAG, "Wave %d: %lu points overwritten before they were sent",
+                         s_waveforms[i].wave, (unsigned long)(s_rings[i].dropped - last_dropped[i]));
+                last_dropped[i] = s_rings[i].dropped;
+            }
+        }
+    }
+}
+
+// Only the handshake semaphores; the task and rings are started by the first pushed sample
+esp_err_t nextion_waveform_init(void)
+{
+    if (s_start_lock) {
+        return ESP_OK;
+    }
+    
+    s_start_lock = xSemaphoreCreateMutex();
+    s_ready = xSemaphoreCreateBinary();
+    s_done = xSemaphoreCreateBinary();
+    if (!s_start_lock || !s_ready || !s_done) {
+        nextion_waveform_deinit();
+        return ESP_ERR_NO_MEM;
+    }
+    
+    s_tokens = WAVE_BUCKET_CAPACITY;
+    s_refill_us = esp_timer_get_time();
+    s_addt_failures = 0;
+    s_addt_backoff_ms = ADDT_RETRY_MIN_MS;
+    return ESP_OK;
+}
+
+void nextion_waveform_deinit(void)
+{
+    if (s_task) {
+        vTaskDelete(s_task);
+        s_task = NULL;
+    }
+    free(s_rings);
+    s_rings = NULL;
+    if (s_start_lock) {
+        vSemaphoreDelete(s_start_lock);
+        s_start_lock = NULL;
+    }
+    if (s_ready) {
+        vSemaphoreDelete(s_ready);
+        s_ready = NULL;
+    }
+    if (s_done) {
+        vSemaphoreDelete(s_done);
+        s_done = NULL;
+    }
+}
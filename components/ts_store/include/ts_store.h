@@ -0,0 +1,60 @@
+#ifndef TS_STORE_H
+#define TS_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Append-only time-series log for the nightly sensor/pump samples, in its own data partition.
+// Both record types are produced from the sensor/pump board link, which is not wired up yet,
+// so until then the store stays empty.
+// Fixed-size records fill 4 KB sectors in a ring; when the ring is full the oldest sector is
+// erased, so every sector sees the same number of erase cycles and the newest data survives.
+// A RAM index of each sector's first timestamp lets range scans seek without reading the log.
+
+#define TS_STORE_PARTITION_LABEL "tsdata"
+#define TS_STORE_SECTOR_SIZE 4096
+#define TS_STORE_RECORD_VALUES 6
+
+typedef enum {
+    TS_RECORD_SENSOR = 1,       // values: room temp x100, humidity x100, pump angle
+    TS_RECORD_PUMP = 2,         // values: active (0/1)
+} ts_record_type_t;
+
+// 32 bytes, so a sector holds a header slot plus 127 records
+typedef struct {
+    uint32_t timestamp;         // Unix seconds; appends must not go backwards
+    uint8_t type;               // ts_record_type_t
+    uint8_t reserved;
+    uint16_t crc;               // Set by ts_store_append
+    int32_t values[TS_STORE_RECORD_VALUES];
+} ts_record_t;
+
+typedef struct {
+    uint32_t capacity;          // Records held before the oldest sector is dropped
+    uint32_t records;           // Slots in use, including any torn by a reset
+    uint32_t oldest_timestamp;  // 0 when empty
+    uint32_t newest_timestamp;
+} ts_store_stats_t;
+
+// Return false to stop the scan early
+typedef bool (*ts_store_visit_t)(const ts_record_t* record, void* ctx);
+
+// Rebuilds the index from the sector headers; ESP_ERR_NOT_FOUND without the partition
+esp_err_t ts_store_init(void);
+esp_err_t ts_store_append(const ts_record_t* record);
+
+// Visits records with from <= timestamp < to, oldest first. The store is only locked while a
+// batch is read from flash, so appends continue during a slow visit (e.g. an upload).
+esp_err_t ts_store_scan(uint32_t from, uint32_t to, ts_store_visit_t visit, void* ctx);
+esp_err_t ts_store_get_stats(ts_store_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,383 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "ts_store.h"
+
+#define TAG "TS_STORE"
+
+#define RECORD_SIZE sizeof(ts_record_t)
+#define SLOTS_PER_SECTOR (TS_STORE_SECTOR_SIZE / RECORD_SIZE)
+#define FIRST_RECORD_SLOT 1         // Slot 0 holds the sector header
+#define SECTOR_MAGIC 0x31535354     // "TSS1"
+#define EMPTY_TIMESTAMP 0xFFFFFFFF
+#define SCAN_BATCH_RECORDS 16
+
+_Static_assert(sizeof(ts_record_t) == 32, "ts_record_t is a flash format");
+
+// Written when a sector is opened. seq grows by one per sector across the whole ring, so the
+// newest sector and the order of the others are recovered from the headers alone.
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t first_timestamp;
+    uint32_t crc;               // Over the fields above
+    uint8_t reserved[16];       // Left erased; pads the header to one record slot
+} sector_header_t;
+
+_Static_assert(sizeof(sector_header_t) == sizeof(ts_record_t), "header takes one record slot");
+
+typedef struct {
+    uint32_t seq;               // 0 = erased or not part of the log
+    uint32_t first_timestamp;
+} sector_index_t;
+
+static const esp_partition_t* g_partition = NULL;
+static SemaphoreHandle_t g_lock = NULL;
+static sector_index_t* g_index = NULL;     // One entry per physical sector
+static uint32_t g_sector_count = 0;
+static uint32_t g_tail = 0;                 // Oldest sector in the log
+static uint32_t g_used = 0;                 // Sectors in the log, from g_tail forward
+static uint32_t g_head_slot = 0;            // Next free slot in the newest sector
+static uint32_t g_last_timestamp = 0;
+
+static uint32_t sector_offset(uint32_t sector)
+{
+    return sector * TS_STORE_SECTOR_SIZE;
+}
+
+static uint32_t head_sector(void)
+{
+    return (g_tail + g_used - 1) % g_sector_count;
+}
+
+static uint32_t header_crc(const sector_header_t* header)
+{
+    return esp_rom_crc32_le(0, (const uint8_t*)header, offsetof(sector_header_t, crc));
+}
+
+static uint16_t record_crc(const ts_record_t* record)
+{
+    ts_record_t copy = *record;
+    copy.crc = 0;
+    return esp_rom_crc16_le(0, (const uint8_t*)&copy, sizeof(copy));
+}
+
+static bool record_is_empty(const ts_record_t* record)
+{
+    const uint8_t* bytes = (const uint8_t*)record;
+    for (size_t i = 0; i < sizeof(*record); i++) {
+        if (bytes[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static esp_err_t read_slot(uint32_t sector, uint32_t slot, ts_record_t* record)
+{
+    return esp_partition_read(g_partition, sector_offset(sector) + slot * RECORD_SIZE, record, RECORD_SIZE);
+}
+
+// Records are only ever appended, so the written slots form a prefix of the sector
+static uint32_t find_free_slot(uint32_t sector)
+{
+    uint32_t lo = FIRST_RECORD_SLOT;
+    uint32_t hi = SLOTS_PER_SECTOR;
+    
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        ts_record_t record;
+        if (read_slot(sector, mid, &record) == ESP_OK && record_is_empty(&record)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+static void load_index(void)
+{
+    uint32_t head = 0;
+    
+    for (uint32_t i = 0; i < g_sector_count; i++) {
+        sector_header_t header;
+        g_index[i].seq = 0;
+        if (esp_partition_read(g_partition, sector_offset(i), &header, sizeof(header)) == ESP_OK &&
+            header.magic == SECTOR_MAGIC && header.crc == header_crc(&header) && header.seq != 0) {
+            g_index[i].seq = header.seq;
+            g_index[i].first_timestamp = header.first_timestamp;
+            if (header.seq > g_index[head].seq) {
+                head = i;
+            }
+        }
+    }
+    
+    g_tail = 0;
+    g_used = 0;
+    g_last_timestamp = 0;
+    if (g_index[head].seq == 0) {
+        return;
+    }
+    
+    // Walk back from the newest sector while the sequence is unbroken; anything else is
+    // stale and gets erased when the ring reaches it
+    g_tail = head;
+    g_used = 1;
+    while (g_used < g_sector_count) {
+        uint32_t prev = (g_tail + g_sector_count - 1) % g_sector_count;
+        if (g_index[prev].seq == 0 || g_index[prev].seq != g_index[g_tail].seq - 1) {
+            break;
+        }
+        g_tail = prev;
+        g_used++;
+    }
+    
+    g_head_slot = find_free_slot(head);
+    g_last_timestamp = g_index[head].first_timestamp;
+    for (uint32_t slot = g_head_slot; slot > FIRST_RECORD_SLOT; slot--) {
+        ts_record_t record;
+        if (read_slot(head, slot - 1, &record) == ESP_OK && record.crc == record_crc(&record)) {
+            g_last_timestamp = record.timestamp;
+            break;
+        }
+    }
+}
+
+// Erases the next sector in the ring (dropping the oldest one when the ring is full) and
+// stamps its header
+static esp_err_t open_sector(uint32_t first_timestamp)
+{
+    uint32_t next = 0;
+    uint32_t seq = 1;
+    
+    if (g_used > 0) {
+        next = (head_sector() + 1) % g_sector_count;
+        seq = g_index[head_sector()].seq + 1;
+        if (g_used == g_sector_count) {
+            g_tail = (g_tail + 1) % g_sector_count;
+            g_used--;
+        }
+    }
+    
+    g_index[next].seq = 0;
+    esp_err_t ret = esp_partition_erase_range(g_partition, sector_offset(next), TS_STORE_SECTOR_SIZE);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    sector_header_t header;
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = SECTOR_MAGIC;
+    header.seq = seq;
+    header.first_timestamp = first_timestamp;
+    header.crc = header_crc(&header);
+    ret = esp_partition_write(g_partition, sector_offset(next), &header, sizeof(header));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    g_index[next].seq = seq;
+    g_index[next].first_timestamp = first_timestamp;
+    if (g_used == 0) {
+        g_tail = next;
+    }
+    g_used++;
+    g_head_slot = FIRST_RECORD_SLOT;
+    return ESP_OK;
+}
+
+esp_err_t ts_store_init(void)
+{
+    if (g_partition) {
+        return ESP_OK;
+    }
+    
+    const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                                TS_STORE_PARTITION_LABEL);
+    if (!partition) {
+        ESP_LOGW(TAG, "No '%s' partition in the partition table", TS_STORE_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (partition->size < 2 * TS_STORE_SECTOR_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    
+    g_sector_count = partition->size / TS_STORE_SECTOR_SIZE;
+    g_index = calloc(g_sector_count, sizeof(sector_index_t));
+    g_lock = xSemaphoreCreateMutex();
+    if (!g_index || !g_lock) {
+        free(g_index);
+        g_index = NULL;
+        if (g_lock) {
+            vSemaphoreDelete(g_lock);
+            g_lock = NULL;
+        }
+        return ESP_ERR_NO_MEM;
+    }
+    
+    g_partition = partition;
+    load_index();
+    
+    ESP_LOGI(TAG, "%lu of %lu sectors in use, newest sample at %lu", (unsigned long)g_used,
+             (unsigned long)g_sector_count, (unsigned long)g_last_timestamp);
+    return ESP_OK;
+}
+
+esp_err_t ts_store_append(const ts_record_t* record)
+{
+    if (!g_partition) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!record || record->timestamp == EMPTY_TIMESTAMP) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+    
+    // The sector index only seeks correctly while timestamps are ordered
+    if (record->timestamp < g_last_timestamp) {
+        xSemaphoreGive(g_lock);
+        ESP_LOGW(TAG, "Sample at %lu is older than the newest stored (%lu), dropped",
+                 (unsigned long)record->timestamp, (unsigned long)g_last_timestamp);
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    esp_err_t ret = ESP_OK;
+    if (g_used == 0 || g_head_slot >= SLOTS_PER_SECTOR) {
+        ret = open_sector(record->timestamp);
+    }
+    if (ret == ESP_OK) {
+        ts_record_t stored = *record;
+        stored.reserved = 0;
+        stored.crc = record_crc(&stored);
+        ret = esp_partition_write(g_partition, sector_offset(head_sector()) + g_head_slot * RECORD_SIZE,
+                                  &stored, RECORD_SIZE);
+        // A failed write may still have touched the slot, so it is never reused
+        g_head_slot++;
+    }
+    if (ret == ESP_OK) {
+        g_last_timestamp = record->timestamp;
+    }
+    
+    xSemaphoreGive(g_lock);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Append failed: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+// Newest log position whose sector starts at or before the timestamp
+static uint32_t seek_sector(uint32_t timestamp)
+{
+    uint32_t lo = 0;
+    uint32_t hi = g_used;
+    
+    while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+        if (g_index[(g_tail + mid) % g_sector_count].first_timestamp <= timestamp) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return g_index[(g_tail + lo) % g_sector_count].seq;
+}
+
+esp_err_t ts_store_scan(uint32_t from, uint32_t to, ts_store_visit_t visit, void* ctx)
+{
+    if (!g_partition) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!visit || from >= to) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    ts_record_t* batch = malloc(SCAN_BATCH_RECORDS * RECORD_SIZE);
+    if (!batch) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+    uint32_t seq = g_used > 0 ? seek_sector(from) : 0;
+    xSemaphoreGive(g_lock);
+    
+    // Position is tracked by sequence number, not physical sector, so a wrap that erases the
+    // sector being scanned is noticed and the scan resumes at the new oldest sector
+    uint32_t slot = FIRST_RECORD_SLOT;
+    esp_err_t ret = ESP_OK;
+    bool done = (seq == 0);
+    
+    while (!done && ret == ESP_OK) {
+        xSemaphoreTake(g_lock, portMAX_DELAY);
+        uint32_t tail_seq = g_index[g_tail].seq;
+        uint32_t head_seq = g_index[head_sector()].seq;
+        if (seq < tail_seq) {
+            seq = tail_seq;
+            slot = FIRST_RECORD_SLOT;
+        }
+        
+        uint32_t count = 0;
+        if (seq <= head_seq) {
+            uint32_t sector = (g_tail + (seq - tail_seq)) % g_sector_count;
+            uint32_t end = seq == head_seq ? g_head_slot : SLOTS_PER_SECTOR;
+            count = end > slot ? end - slot : 0;
+            if (count > SCAN_BATCH_RECORDS) {
+                count = SCAN_BATCH_RECORDS;
+            }
+            if (count > 0) {
+                ret = esp_partition_read(g_partition, sector_offset(sector) + slot * RECORD_SIZE, batch,
+                                         count * RECORD_SIZE);
+            }
+        }
+        bool at_head = seq >= head_seq;
+        xSemaphoreGive(g_lock);
+        
+        for (uint32_t i = 0; i < count && ret == ESP_OK && !done; i++) {
+            // Slots torn by a reset mid-write fail the CRC and are skipped
+            if (batch[i].crc != record_crc(&batch[i]) || batch[i].timestamp < from) {
+                continue;
+            }
+            done = batch[i].timestamp >= to || !visit(&batch[i], ctx);
+        }
+        
+        slot += count;
+        if (count == 0) {
+            if (at_head) {
+                break;
+            }
+            seq++;
+            slot = FIRST_RECORD_SLOT;
+        }
+    }
+    
+    free(batch);
+    return ret;
+}
+
+esp_err_t ts_store_get_stats(ts_store_stats_t* stats)
+{
+    if (!g_partition) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+    stats->capacity = (g_sector_count - 1) * (SLOTS_PER_SECTOR - FIRST_RECORD_SLOT);
+    stats->records = 0;
+    stats->oldest_timestamp = 0;
+    stats->newest_timestamp = g_last_timestamp;
+    if (g_used > 0) {
+        stats->records = (g_used - 1) * (SLOTS_PER_SECTOR - FIRST_RECORD_SLOT) + g_head_slot - FIRST_RECORD_SLOT;
+        stats->oldest_timestamp = g_index[g_tail].first_timestamp;
+    }
+    xSemaphoreGive(g_lock);
+    return ESP_OK;
+}
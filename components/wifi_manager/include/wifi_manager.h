@@ -17,16 +17,29 @@ typedef enum {
     WIFI_MGR_EVENT_PROVISIONING_SUCCESS,
     WIFI_MGR_EVENT_PROVISIONING_FAILED,
     WIFI_MGR_EVENT_CONNECTION_MAX_RETRIES_FAILED,
-    WIFI_MGR_EVENT_NORMAL_MODE_CONNECTED
+    WIFI_MGR_EVENT_NORMAL_MODE_CONNECTED,
+    WIFI_MGR_EVENT_STATE_CHANGED            // data: the new wifi_manager_state_t, cast to a pointer
 } wifi_manager_event_t;
 
+typedef enum {
+    WIFI_MGR_STATE_IDLE,
+    WIFI_MGR_STATE_AP,                      // Provisioning access point is up
+    WIFI_MGR_STATE_CONNECTING,              // Scan, association and DHCP, including retries
+    WIFI_MGR_STATE_CONNECTED,               // Station has an IP address
+    WIFI_MGR_STATE_FAILED                   // Gave up after the retry limit
+} wifi_manager_state_t;
+
 typedef void (*wifi_event_callback_t)(wifi_manager_event_t event, void* data);
 
 esp_err_t wifi_manager_init(void);
 esp_err_t wifi_manager_start_provisioning(const char* device_id, const char* password);
 esp_err_t wifi_manager_stop_provisioning(void);
+// Both return as soon as the station is started. The result arrives through the callback:
+// PROVISIONING_SUCCESS once, or NORMAL_MODE_CONNECTED on every (re)connect; PROVISIONING_FAILED
+// after the retry limit. Each call reuses the same STA netif.
 esp_err_t wifi_manager_connect_wifi(const char* ssid, const char* password);
 esp_err_t wifi_manager_connect_wifi_normal_mode(const char* ssid, const char* password);
+wifi_manager_state_t wifi_manager_get_state(void);
 esp_err_t wifi_manager_set_event_callback(wifi_event_callback_t callback);
 bool wifi_manager_is_connected(void);
 esp_err_t wifi_manager_get_ip_info(esp_netif_ip_info_t* ip_info);
@@ -3,10 +3,13 @@
 #include "esp_wifi.h"
 #include "esp_netif.h"
 #include "esp_mac.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "lwip/dns.h"
 #include "lwip/sockets.h"
+#include <stdint.h>
 #include <string.h>
 
 static const char *TAG = "WIFI_MANAGER";
@@ -20,6 +23,113 @@ static esp_netif_t* s_sta_netif = NULL;
 static esp_netif_t* s_ap_netif = NULL;
 static int s_retry_num = 0;
 static const int MAXIMUM_RETRY = 5;
+static volatile wifi_manager_state_t s_state = WIFI_MGR_STATE_IDLE;
+static wifi_manager_event_t s_connected_event = WIFI_MGR_EVENT_NORMAL_MODE_CONNECTED;
+static bool s_first_ip_pending = false;     // Current connect request has not reached an IP yet
+
+#define LINK_NVS_NAMESPACE "wifi_link"
+#define LINK_NVS_KEY "last"
+
+// Last AP that handed out an address. Connecting straight to its BSSID on its channel skips
+// the all-channel scan; the DHCP lease itself is reused by lwIP (CONFIG_LWIP_DHCP_RESTORE_LAST_IP).
+typedef struct {
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_link_cache_t;
+
+static wifi_link_cache_t s_link_cache = {0};
+static bool s_fast_connect = false;        // Current attempt is directed at the cached AP
+static int64_t s_connect_start_us = 0;
+
+static void load_link_cache(void)
+{
+    nvs_handle_t nvs_handle;
+    size_t size = sizeof(s_link_cache);
+    
+    if (nvs_open(LINK_NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(nvs_handle, LINK_NVS_KEY, &s_link_cache, &size) != ESP_OK || size != sizeof(s_link_cache)) {
+        memset(&s_link_cache, 0, sizeof(s_link_cache));
+    }
+    nvs_close(nvs_handle);
+}
+
+// Rewritten only when the AP or its channel changed, so an ordinary boot costs no flash write
+static void save_link_cache(void)
+{
+    wifi_ap_record_t ap;
+    wifi_config_t wifi_config;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK || esp_wifi_get_config(WIFI_IF_STA, &wifi_config) != ESP_OK) {
+        return;
+    }
+    
+    wifi_link_cache_t link = {0};
+    memcpy(link.ssid, wifi_config.sta.ssid, sizeof(wifi_config.sta.ssid));
+    memcpy(link.bssid, ap.bssid, sizeof(link.bssid));
+    link.channel = ap.primary;
+    if (memcmp(&link, &s_link_cache, sizeof(link)) == 0) {
+        return;
+    }
+    
+    nvs_handle_t nvs_handle;
+    if (nvs_open(LINK_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(nvs_handle, LINK_NVS_KEY, &link, sizeof(link)) == ESP_OK && nvs_commit(nvs_handle) == ESP_OK) {
+        s_link_cache = link;
+        ESP_LOGI(TAG, "Cached AP %02x:%02x:%02x:%02x:%02x:%02x on channel %d for fast reconnect",
+                 link.bssid[0], link.bssid[1], link.bssid[2], link.bssid[3], link.bssid[4], link.bssid[5],
+                 link.channel);
+    }
+    nvs_close(nvs_handle);
+}
+
+static void apply_link_cache(wifi_config_t* wifi_config)
+{
+    s_fast_connect = s_link_cache.channel != 0 &&
+                     strncmp(s_link_cache.ssid, (const char*)wifi_config->sta.ssid, sizeof(wifi_config->sta.ssid)) == 0;
+    if (!s_fast_connect) {
+        wifi_config->sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        wifi_config->sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+        return;
+    }
+    
+    wifi_config->sta.bssid_set = true;
+    memcpy(wifi_config->sta.bssid, s_link_cache.bssid, sizeof(wifi_config->sta.bssid));
+    wifi_config->sta.channel = s_link_cache.channel;
+    wifi_config->sta.scan_method = WIFI_FAST_SCAN;
+    ESP_LOGI(TAG, "Fast connect to cached AP on channel %d", s_link_cache.channel);
+}
+
+// The cached AP is gone or changed channel: drop the BSSID/channel pin and scan everything
+static void fall_back_to_full_scan(void)
+{
+    wifi_config_t wifi_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) != ESP_OK) {
+        return;
+    }
+    
+    wifi_config.sta.bssid_set = false;
+    wifi_config.sta.channel = 0;
+    wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+}
+
+static void set_state(wifi_manager_state_t state)
+{
+    if (s_state == state) {
+        return;
+    }
+    s_state = state;
+    
+    ESP_LOGI(TAG, "State -> %d", state);
+    if (s_event_callback) {
+        s_event_callback(WIFI_MGR_EVENT_STATE_CHANGED, (void*)(uintptr_t)state);
+    }
+}
 
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
                                int32_t event_id, void* event_data)
@@ -27,22 +137,47 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < MAXIMUM_RETRY) {
+        if (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT) {
+            xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+            set_state(WIFI_MGR_STATE_CONNECTING);
+            if (s_event_callback) {
+                s_event_callback(WIFI_MGR_EVENT_STA_DISCONNECTED, NULL);
+            }
+        }
+        
+        if (s_fast_connect) {
+            // One full scan before the normal retries; also covers a later drop from the cached AP
+            s_fast_connect = false;
+            ESP_LOGW(TAG, "Cached AP unreachable, falling back to a full scan");
+            fall_back_to_full_scan();
+            esp_wifi_connect();
+        } else if (s_retry_num < MAXIMUM_RETRY) {
             esp_wifi_connect();
             s_retry_num++;
             ESP_LOGI(TAG, "retry to connect to the AP (%d/%d)", s_retry_num, MAXIMUM_RETRY);
         } else {
             xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
             ESP_LOGE(TAG, "WiFi connection failed after %d retries", MAXIMUM_RETRY);
+            set_state(WIFI_MGR_STATE_FAILED);
             if (s_event_callback) {
                 s_event_callback(WIFI_MGR_EVENT_CONNECTION_MAX_RETRIES_FAILED, NULL);
+                if (s_first_ip_pending) {
+                    s_event_callback(WIFI_MGR_EVENT_PROVISIONING_FAILED, NULL);
+                }
             }
+            s_first_ip_pending = false;
         }
         ESP_LOGI(TAG,"connect to the AP fail");
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
         
+        int64_t now_us = esp_timer_get_time();
+        ESP_LOGI(TAG, "IP %lu ms after boot, %lu ms after connect start (%s)",
+                 (unsigned long)(now_us / 1000), (unsigned long)((now_us - s_connect_start_us) / 1000),
+                 s_fast_connect ? "cached AP" : "full scan");
+        save_link_cache();
+        
         // Set DNS servers to Cloudflare DNS for better connectivity
         ip_addr_t dns_primary, dns_secondary;
         memset(&dns_primary, 0, sizeof(ip_addr_t));    // Critical: Initialize to zero
@@ -59,9 +194,17 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
         
         s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        set_state(WIFI_MGR_STATE_CONNECTED);
         if (s_event_callback) {
             s_event_callback(WIFI_MGR_EVENT_STA_CONNECTED, NULL);
+            
+            // Provisioning reports its first IP only; normal mode re-announces every reconnect
+            // so the home screen and heartbeat resume
+            if (s_first_ip_pending || s_connected_event == WIFI_MGR_EVENT_NORMAL_MODE_CONNECTED) {
+                s_event_callback(s_connected_event, NULL);
+            }
         }
+        s_first_ip_pending = false;
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STACONNECTED) {
         wifi_event_ap_staconnected_t* event = (wifi_event_ap_staconnected_t*) event_data;
         ESP_LOGI(TAG, "station %02x:%02x:%02x:%02x:%02x:%02x join, AID=%d", 
@@ -92,6 +235,7 @@ esp_err_t wifi_manager_init(void)
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    load_link_cache();
     
     ESP_LOGI(TAG, "WiFi manager initialized");
     return ESP_OK;
@@ -103,7 +247,9 @@ esp_err_t wifi_manager_start_provisioning(const char* ssid, const char* password
         return ESP_ERR_INVALID_ARG;
     }
     
-    s_ap_netif = esp_netif_create_default_wifi_ap();
+    if (!s_ap_netif) {
+        s_ap_netif = esp_netif_create_default_wifi_ap();
+    }
     
     wifi_config_t wifi_config = {
         .ap = {
@@ -122,6 +268,7 @@ esp_err_t wifi_manager_start_provisioning(const char* ssid, const char* password
     ESP_ERROR_CHECK(esp_wifi_start());
     
     ESP_LOGI(TAG, "WiFi AP started. SSID:%s password:%s", ssid, password);
+    set_state(WIFI_MGR_STATE_AP);
     
     if (s_event_callback) {
         s_event_callback(WIFI_MGR_EVENT_AP_START, NULL);
@@ -134,10 +281,8 @@ esp_err_t wifi_manager_stop_provisioning(void)
 {
     esp_err_t ret = esp_wifi_stop();
     if (ret == ESP_OK) {
-        if (s_ap_netif) {
-            esp_netif_destroy_default_wifi(s_ap_netif);
-            s_ap_netif = NULL;
-        }
+        // The AP netif is kept for the next start, like the STA one
+        set_state(WIFI_MGR_STATE_IDLE);
         
         if (s_event_callback) {
             s_event_callback(WIFI_MGR_EVENT_AP_STOP, NULL);
@@ -147,13 +292,18 @@ esp_err_t wifi_manager_stop_provisioning(void)
     return ret;
 }
 
-esp_err_t wifi_manager_connect_wifi(const char* ssid, const char* password)
+// Configures the station and returns; association, retries and DHCP continue in the event
+// handler, which reports the outcome through the callback
+static esp_err_t start_station(const char* ssid, const char* password, wifi_manager_event_t connected_event)
 {
     if (!ssid) {
         return ESP_ERR_INVALID_ARG;
     }
     
-    s_sta_netif = esp_netif_create_default_wifi_sta();
+    // Created once and reused by every connect request
+    if (!s_sta_netif) {
+        s_sta_netif = esp_netif_create_default_wifi_sta();
+    }
     
     wifi_config_t wifi_config = {
         .sta = {
@@ -169,6 +319,7 @@ esp_err_t wifi_manager_connect_wifi(const char* ssid, const char* password)
     if (password) {
         strncpy((char*)wifi_config.sta.password, password, sizeof(wifi_config.sta.password));
     }
+    apply_link_cache(&wifi_config);
     
     // Stop WiFi first to avoid ESP_ERR_WIFI_STATE error
     esp_err_t ret = esp_wifi_stop();
@@ -177,35 +328,25 @@ esp_err_t wifi_manager_connect_wifi(const char* ssid, const char* password)
         return ret;
     }
     
+    s_retry_num = 0;
+    s_connected_event = connected_event;
+    s_first_ip_pending = true;
+    xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+    
     // Set to STA mode only for clean connection
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    set_state(WIFI_MGR_STATE_CONNECTING);
+    s_connect_start_us = esp_timer_get_time();
     ESP_ERROR_CHECK(esp_wifi_start());
     
     ESP_LOGI(TAG, "Connecting to WiFi SSID:%s", ssid);
-    
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           pdMS_TO_TICKS(30000)); // 30 second timeout
-    
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "Connected to WiFi");
-        if (s_event_callback) {
-            s_event_callback(WIFI_MGR_EVENT_PROVISIONING_SUCCESS, NULL);
-        }
-        return ESP_OK;
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to WiFi");
-        if (s_event_callback) {
-            s_event_callback(WIFI_MGR_EVENT_PROVISIONING_FAILED, NULL);
-        }
-        return ESP_FAIL;
-    } else {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
-        return ESP_ERR_TIMEOUT;
-    }
+    return ESP_OK;
+}
+
+esp_err_t wifi_manager_connect_wifi(const char* ssid, const char* password)
+{
+    return start_station(ssid, password, WIFI_MGR_EVENT_PROVISIONING_SUCCESS);
 }
 
 esp_err_t wifi_manager_set_event_callback(wifi_event_callback_t callback)
@@ -235,61 +376,10 @@ esp_err_t wifi_manager_get_ip_info(esp_netif_ip_info_t* ip_info)
 
 esp_err_t wifi_manager_connect_wifi_normal_mode(const char* ssid, const char* password)
 {
-    if (!ssid) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    
-    s_sta_netif = esp_netif_create_default_wifi_sta();
-    
-    wifi_config_t wifi_config = {
-        .sta = {
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-            .pmf_cfg = {
-                .capable = true,
-                .required = false
-            },
-        },
-    };
-    
-    strncpy((char*)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid));
-    if (password) {
-        strncpy((char*)wifi_config.sta.password, password, sizeof(wifi_config.sta.password));
-    }
-    
-    // Stop WiFi first to avoid ESP_ERR_WIFI_STATE error
-    esp_err_t ret = esp_wifi_stop();
-    if (ret != ESP_OK && ret != ESP_ERR_WIFI_NOT_STARTED) {
-        ESP_LOGE(TAG, "Failed to stop WiFi: %s", esp_err_to_name(ret));
-        return ret;
-    }
-    
-    // Set to STA mode only for clean connection
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
-    
-    ESP_LOGI(TAG, "Connecting to WiFi SSID:%s", ssid);
-    
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           pdMS_TO_TICKS(30000)); // 30 second timeout
-    
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "Connected to WiFi in normal mode");
-        if (s_event_callback) {
-            s_event_callback(WIFI_MGR_EVENT_NORMAL_MODE_CONNECTED, NULL);
-        }
-        return ESP_OK;
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to WiFi in normal mode");
-        if (s_event_callback) {
-            s_event_callback(WIFI_MGR_EVENT_PROVISIONING_FAILED, NULL);
-        }
-        return ESP_FAIL;
-    } else {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
-        return ESP_ERR_TIMEOUT;
-    }
+    return start_station(ssid, password, WIFI_MGR_EVENT_NORMAL_MODE_CONNECTED);
+}
+
+wifi_manager_state_t wifi_manager_get_state(void)
+{
+    return s_state;
 }
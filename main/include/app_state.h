@@ -2,6 +2,8 @@
 #define APP_STATE_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
 
 #define DEVICE_ID_MAX_LEN 16
 #define AUTH_TOKEN_MAX_LEN 256
@@ -12,6 +14,9 @@ typedef struct {
     char auth_token[AUTH_TOKEN_MAX_LEN];
     char device_token[DEVICE_TOKEN_MAX_LEN];
     bool home_mode_active;
+    // Activity signals for the FOTA install window, fed by the sensor/pump board link
+    _Atomic int64_t last_presence_us;   // esp_timer time of the last sensor contact or panel touch, 0 = never (64-bit: atomic so RV32 never tears it)
+    volatile bool pump_active;
 } app_state_t;
 
 extern app_state_t g_app_state;
@@ -21,5 +26,7 @@ void app_state_set_device_id(const char* device_id);
 void app_state_set_auth_token(const char* token);
 void app_state_set_device_token(const char* token);
 void app_state_set_home_mode(bool active);
+void app_state_note_presence(void);
+void app_state_set_pump_active(bool active);
 
 #endif
@@ -11,4 +11,8 @@ void nextion_event_handler(nextion_event_t* event);
 void wifi_event_handler(wifi_manager_event_t event, void* data);
 void wifi_config_handler(const wifi_credentials_t* credentials);
 
+// Callback entry points - post to the event dispatcher and return immediately
+void nextion_event_dispatch(nextion_event_t* event);
+void wifi_event_dispatch(wifi_manager_event_t event, void* data);
+
 #endif
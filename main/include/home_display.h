@@ -2,6 +2,7 @@
 #define HOME_DISPLAY_H
 
 #include "api_client.h"
+#include "fota_manager.h"
 
 #define TEMPERATURE_DEFAULT "22"
 #define WEATHER_DEFAULT "Clear"
@@ -11,5 +12,6 @@
 #define OFFLINE_DISPLAY "--"
 
 void home_display_update(void);
+void home_display_render_fota_status(const fota_status_t* status);
 
 #endif
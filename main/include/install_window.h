@@ -0,0 +1,14 @@
+#ifndef INSTALL_WINDOW_H
+#define INSTALL_WINDOW_H
+
+#include <stdbool.h>
+
+#define INSTALL_WINDOW_START_HOUR 11            // Local time, inclusive
+#define INSTALL_WINDOW_END_HOUR 17              // Local time, exclusive
+#define INSTALL_WINDOW_QUIET_MS (30 * 60 * 1000) // No sensor contact or touch for this long
+
+// FOTA install guard: a staged image is only swapped in during the daytime window, with nobody
+// on the pillow and the pump idle. Never opens before the local clock is set.
+bool install_window_is_open(void);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef LOCAL_CLOCK_H
+#define LOCAL_CLOCK_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define LOCAL_CLOCK_TZ "KST-9"
+#define LOCAL_CLOCK_NTP_SERVER "pool.ntp.org"
+#define LOCAL_CLOCK_MIN_VALID_YEAR 2024
+#define LOCAL_CLOCK_SNTP_FRESH_S (60 * 60)     // Server time is ignored this long after an SNTP sync
+#define LOCAL_CLOCK_DRIFT_TOLERANCE_S 2        // Below this the server time is within HTTP latency
+#define LOCAL_CLOCK_STEP_THRESHOLD_S 60        // Larger drift is stepped, smaller drift is slewed
+
+// SNTP + local timezone; renders the home clock (t5) and alarm (t6, t9) on every minute boundary
+esp_err_t local_clock_init(void);
+bool local_clock_is_valid(void);
+
+// Heartbeat hooks - ISO 8601 timestamps such as "2025-08-29T03:25:12+09:00"
+void local_clock_correct_from_server(const char* server_time);
+void local_clock_set_alarm(const char* next_alarm);
+
+#endif
@@ -4,6 +4,7 @@
 #define HEARTBEAT_INTERVAL_MS 30000
 #define HOME_UPDATE_FREQUENCY 10
 #define FOTA_CHECK_FREQUENCY 120
+#define MAIN_LOOP_TASK_PRIORITY 3       // app_main starts at 1; heartbeats must outrank a background FOTA download
 
 void main_loop_run(const char* device_id);
 
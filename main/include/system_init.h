@@ -5,6 +5,14 @@
 
 #define SETUP_DELAY_MS 3000
 
+// AVR sub-boards (ATmega328P + Optiboot) share the LP UART; each has its own reset line
+#define SUBBOARD_UART_NUM LP_UART_NUM_0
+#define SUBBOARD_TX_PIN 5
+#define SUBBOARD_RX_PIN 4
+#define SUBBOARD_BAUD_RATE 115200
+#define SENSOR_BOARD_RESET_PIN 6
+#define PUMP_BOARD_RESET_PIN 7
+
 esp_err_t system_components_init(void);
 void system_callbacks_setup(void);
 void provisioning_mode_start(const char* device_id);
@@ -1,5 +1,9 @@
 #include <string.h>
+#include <time.h>
+#include "esp_timer.h"
 #include "app_state.h"
+#include "local_clock.h"
+#include "ts_store.h"
 
 app_state_t g_app_state = {0};
 
@@ -27,3 +31,27 @@ void app_state_set_home_mode(bool active)
 {
     g_app_state.home_mode_active = active;
 }
+
+void app_state_note_presence(void)
+{
+    atomic_store(&g_app_state.last_presence_us, esp_timer_get_time());
+}
+
+void app_state_set_pump_active(bool active)
+{
+    if (g_app_state.pump_active == active) {
+        return;
+    }
+    g_app_state.pump_active = active;
+    
+    // Pump runs are logged as on/off edges next to the sensor samples. No caller yet: this is
+    // the hook for the pump board link.
+    if (local_clock_is_valid()) {
+        ts_record_t record = {
+            .timestamp = (uint32_t)time(NULL),
+            .type = TS_RECORD_PUMP,
+            .values = { active ? 1 : 0 },
+        };
+        ts_store_append(&record);
+    }
+}
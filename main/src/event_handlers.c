@@ -11,11 +11,14 @@
 #include "app_state.h"
 #include "home_display.h"
 #include "web_server.h"
+#include "event_dispatcher.h"
 
 static const char *TAG = "EVENT_HANDLERS";
 
 static void handle_home_screen_events(nextion_event_t* event)
 {
+    nextion_latency_mark(event, NEXTION_STAGE_ACTION_START);
+    
     switch (event->command) {
         case NEXTION_CMD_GO_SETTINGS:
             ESP_LOGI(TAG, "Settings button pressed");
@@ -37,6 +40,8 @@ static void handle_home_screen_events(nextion_event_t* event)
         case NEXTION_CMD_FACTORY_RESET:
             ESP_LOGI(TAG, "Factory reset button pressed");
             nextion_show_setup_status("Factory Reset...");
+            nextion_latency_mark(event, NEXTION_STAGE_ACTION_DONE);
+            nextion_latency_commit(event);
             vTaskDelay(pdMS_TO_TICKS(STATUS_DELAY_MS));
             device_config_factory_reset();
             esp_restart();
@@ -46,6 +51,9 @@ static void handle_home_screen_events(nextion_event_t* event)
             ESP_LOGI(TAG, "Unknown command from home screen");
             break;
     }
+    
+    nextion_latency_mark(event, NEXTION_STAGE_ACTION_DONE);
+    nextion_latency_commit(event);
 }
 
 void nextion_event_handler(nextion_event_t* event)
@@ -53,11 +61,48 @@ void nextion_event_handler(nextion_event_t* event)
     ESP_LOGI(TAG, "NEXTION Event: Page %d, Component %d, Command %d", 
              event->page_id, event->component_id, event->command);
     
-    if (event->page_id == 1) {
+    if (event->page_changed) {
+        // Flush fields that were deferred while this page was hidden
+        nextion_render();
+    }
+    
+    if (event->event == NEXTION_EVENT_TOUCH_PRESS && event->page_id == NEXTION_PAGE_HOME) {
         handle_home_screen_events(event);
     }
 }
 
+static void run_nextion_event(void* data)
+{
+    nextion_event_handler((nextion_event_t*)data);
+}
+
+static event_priority_t nextion_event_priority(const nextion_event_t* event)
+{
+    switch (event->command) {
+        case NEXTION_CMD_REFRESH_DATA:
+        case NEXTION_CMD_FACTORY_RESET:
+            return EVENT_PRIORITY_BACKGROUND;
+        default:
+            return EVENT_PRIORITY_UI;
+    }
+}
+
+// Registered with nextion_hmi; runs in the UART reader task, so it only hands the event off
+void nextion_event_dispatch(nextion_event_t* event)
+{
+    nextion_latency_mark(event, NEXTION_STAGE_CALLBACK);
+    
+    if (event->event == NEXTION_EVENT_TOUCH_PRESS) {
+        app_state_note_presence();
+    }
+    
+    esp_err_t ret = event_dispatcher_post(nextion_event_priority(event), run_nextion_event,
+                                          event, sizeof(nextion_event_t));
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "NEXTION event dropped: %s", esp_err_to_name(ret));
+    }
+}
+
 static esp_err_t provision_device_new_api(const char* provisioning_code)
 {
     // Use dynamic allocation to avoid stack overflow
@@ -97,11 +142,26 @@ static esp_err_t provision_device_new_api(const char* provisioning_code)
     esp_err_t ret = api_client_provision_device(request, response, api_response);
     if (ret == ESP_OK && api_response->success) {
         ESP_LOGI(TAG, "Device provisioned successfully, received token");
-        nextion_show_setup_status("Provisioning Complete");
-        device_config_set_provisioned(true);
         
-        // Save device token instead of temp token
-        device_config_save_device_token(response->device_token);
+        // Flag and device token (instead of temp token) land together, or neither does
+        ret = device_config_txn_begin();
+        if (ret == ESP_OK) {
+            ret = device_config_txn_set_provisioned(true);
+            if (ret == ESP_OK) {
+                ret = device_config_txn_set_device_token(response->device_token);
+            }
+            if (ret == ESP_OK) {
+                ret = device_config_txn_commit();
+            } else {
+                device_config_txn_abort();
+            }
+        }
+    }
+    
+    // A token that never reached NVS is a failed attempt: the caller retries instead of
+    // rebooting into Phase 3 without one
+    if (ret == ESP_OK && api_response->success) {
+        nextion_show_setup_status("Provisioning Complete");
         
         app_state_set_device_id(device_id);
         app_state_set_device_token(response->device_token);
@@ -109,9 +169,12 @@ static esp_err_t provision_device_new_api(const char* provisioning_code)
         vTaskDelay(pdMS_TO_TICKS(STATUS_DELAY_MS));
         
         // Change to page 1 after successful provisioning
-        nextion_change_page(1);
+        nextion_change_page(NEXTION_PAGE_HOME);
         app_state_set_home_mode(true);
         
+    } else if (api_response->success) {
+        ESP_LOGE(TAG, "Failed to save the device token: %s", esp_err_to_name(ret));
+        nextion_show_setup_status("Provisioning Failed");
     } else {
         ESP_LOGE(TAG, "Device provisioning failed: %s", api_response->message);
         nextion_show_setup_status("Provisioning Failed");
@@ -203,6 +266,8 @@ static void handle_wifi_connected(void)
 
 void wifi_event_handler(wifi_manager_event_t event, void* data)
 {
+    size_t token_len;
+    
     switch (event) {
         case WIFI_MGR_EVENT_AP_START:
             ESP_LOGI(TAG, "Provisioning AP started");
@@ -212,11 +277,10 @@ void wifi_event_handler(wifi_manager_event_t event, void* data)
             break;
             
         case WIFI_MGR_EVENT_STA_CONNECTED:
-            nextion_show_setup_status("WiFi Connected Successfully!");
             // Only handle STA connected in Phase 2 (no device_token yet)
-            char device_token[512];
-            device_config_get_device_token(device_token);
-            if (strlen(device_token) == 0) {
+            device_config_device_token_view(&token_len);
+            if (token_len == 0) {
+                nextion_show_setup_status("WiFi Connected Successfully!");
                 ESP_LOGI(TAG, "WiFi connected in Phase 2, will handle via provisioning success");
                 handle_wifi_connected();
             } else {
@@ -226,7 +290,11 @@ void wifi_event_handler(wifi_manager_event_t event, void* data)
             
         case WIFI_MGR_EVENT_STA_DISCONNECTED:
             ESP_LOGE(TAG, "WiFi disconnected");
-            if (device_config_is_provisioned()) {
+            device_config_device_token_view(&token_len);
+            if (token_len > 0) {
+                // Phase 3: the home page stays up while the supervisor reconnects
+                ESP_LOGI(TAG, "Reconnecting in the background, heartbeat paused");
+            } else if (device_config_is_provisioned()) {
                 nextion_show_setup_status("WiFi Disconnected - Reconnecting...");
             } else {
                 nextion_show_setup_status("WiFi Disconnected");
@@ -256,10 +324,9 @@ void wifi_event_handler(wifi_manager_event_t event, void* data)
             break;
             
         case WIFI_MGR_EVENT_NORMAL_MODE_CONNECTED:
+            // Fires on every (re)connect. normal_mode_start already showed the home page and a
+            // drop leaves it up, so this only resumes the heartbeat.
             ESP_LOGI(TAG, "WiFi connected in normal mode - Phase 3");
-            nextion_show_setup_status("WiFi Connected - Normal Mode");
-            vTaskDelay(pdMS_TO_TICKS(STATUS_DELAY_MS));
-            nextion_change_page(1);
             app_state_set_home_mode(true);
             break;
             
@@ -268,6 +335,32 @@ void wifi_event_handler(wifi_manager_event_t event, void* data)
     }
 }
 
+typedef struct {
+    wifi_manager_event_t event;
+    void* data;
+} wifi_event_item_t;
+
+static void run_wifi_event(void* data)
+{
+    wifi_event_item_t* item = (wifi_event_item_t*)data;
+    wifi_event_handler(item->event, item->data);
+}
+
+// Registered with wifi_manager; Wi-Fi handlers do HTTPS and restarts, so they run in order
+// on the background worker instead of the system event task
+void wifi_event_dispatch(wifi_manager_event_t event, void* data)
+{
+    wifi_event_item_t item = {
+        .event = event,
+        .data = data,
+    };
+    
+    esp_err_t ret = event_dispatcher_post(EVENT_PRIORITY_BACKGROUND, run_wifi_event, &item, sizeof(item));
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "WiFi event %d dropped: %s", event, esp_err_to_name(ret));
+    }
+}
+
 static esp_err_t validate_and_save_wifi_config(const wifi_credentials_t* credentials)
 {
     if (!utils_validate_wifi_credentials(credentials->ssid, credentials->password)) {
@@ -276,14 +369,24 @@ static esp_err_t validate_and_save_wifi_config(const wifi_credentials_t* credent
         return ESP_ERR_INVALID_ARG;
     }
     
-    device_config_save_wifi_credentials(credentials->ssid, credentials->password);
-    device_config_save_auth_token(credentials->token);
-    device_config_save_provisioning_code(credentials->provisioning_code);
+    // One transaction, so a reset part-way never boots into Phase 2 with half the settings
+    esp_err_t ret = device_config_txn_begin();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    device_config_txn_set_wifi_credentials(credentials->ssid, credentials->password);
+    device_config_txn_set_auth_token(credentials->token);
+    device_config_txn_set_provisioning_code(credentials->provisioning_code);
     
     // Mark as provisioned for Phase 2
-    device_config_set_provisioned(true);
+    device_config_txn_set_provisioned(true);
     
-    return ESP_OK;
+    ret = device_config_txn_commit();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save WiFi config: %s", esp_err_to_name(ret));
+        nextion_show_setup_status("WiFi Config Save Failed");
+    }
+    return ret;
 }
 
 void wifi_config_handler(const wifi_credentials_t* credentials)
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <string.h>
 #include "esp_log.h"
 #include "home_display.h"
@@ -40,29 +41,34 @@ void home_display_update(void)
     }
     
     // FOTA 상태 확인 및 표시
-    if (fota_is_update_in_progress()) {
-        fota_status_t fota_status;
-        if (fota_get_status(&fota_status) == ESP_OK) {
-            switch (fota_status.state) {
-                case FOTA_STATE_DOWNLOADING:
-                    nextion_show_fota_status("Downloading...");
-                    break;
-                case FOTA_STATE_VERIFYING:
-                    nextion_show_fota_status("Verifying...");
-                    break;
-                case FOTA_STATE_INSTALLING:
-                    nextion_show_fota_status("Installing...");
-                    break;
-                default:
-                    nextion_show_fota_status("FOTA");
-                    break;
+    fota_status_t fota_status;
+    if (fota_get_status(&fota_status) == ESP_OK) {
+        home_display_render_fota_status(&fota_status);
+    }
+}
+
+// Display only - runs on the UI worker for every FOTA progress event, so no API calls here
+void home_display_render_fota_status(const fota_status_t* status)
+{
+    char text[32];
+    
+    switch (status->state) {
+        case FOTA_STATE_DOWNLOADING:
+            snprintf(text, sizeof(text), "Downloading %d%%", status->progress_percent);
+            nextion_show_fota_status(text);
+            break;
+        case FOTA_STATE_VERIFYING:
+            nextion_show_fota_status("Verifying...");
+            break;
+        case FOTA_STATE_INSTALLING:
+            nextion_show_fota_status("Installing...");
+            break;
+        default:
+            if (fota_is_update_pending()) {
+                nextion_show_fota_status("Ready to Update");
+            } else {
+                nextion_clear_fota_status();
             }
-        } else {
-            nextion_show_fota_status("FOTA");
-        }
-    } else if (fota_is_update_pending()) {
-        nextion_show_fota_status("Ready to Update");
-    } else {
-        nextion_clear_fota_status();
+            break;
     }
 }
@@ -0,0 +1,38 @@
+#include <time.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "install_window.h"
+#include "local_clock.h"
+#include "app_state.h"
+
+static const char *TAG = "INSTALL_WINDOW";
+
+bool install_window_is_open(void)
+{
+    // Without a valid clock "daytime" is unknown, so keep waiting rather than risk the night
+    if (!local_clock_is_valid()) {
+        return false;
+    }
+    
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    if (local.tm_hour < INSTALL_WINDOW_START_HOUR || local.tm_hour >= INSTALL_WINDOW_END_HOUR) {
+        return false;
+    }
+    
+    if (g_app_state.pump_active) {
+        ESP_LOGD(TAG, "Pump active");
+        return false;
+    }
+    
+    int64_t last_presence_us = atomic_load(&g_app_state.last_presence_us);
+    if (last_presence_us != 0 &&
+        esp_timer_get_time() - last_presence_us < INSTALL_WINDOW_QUIET_MS * 1000LL) {
+        ESP_LOGD(TAG, "Recent activity");
+        return false;
+    }
+    
+    ESP_LOGI(TAG, "Install window open (%02d:%02d)", local.tm_hour, local.tm_min);
+    return true;
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_netif_sntp.h"
+#include "local_clock.h"
+#include "nextion_hmi.h"
+#include "event_dispatcher.h"
+
+static const char *TAG = "LOCAL_CLOCK";
+
+#define ALARM_NONE -1
+
+static esp_timer_handle_t s_minute_timer = NULL;
+static volatile int64_t s_last_sntp_sync_us = 0;
+
+// Minutes after local midnight; a single word so the UI worker never reads a torn value
+static volatile int32_t s_alarm_minutes = ALARM_NONE;
+
+static bool time_is_valid(time_t now)
+{
+    struct tm local;
+    localtime_r(&now, &local);
+    return local.tm_year + 1900 >= LOCAL_CLOCK_MIN_VALID_YEAR;
+}
+
+bool local_clock_is_valid(void)
+{
+    return time_is_valid(time(NULL));
+}
+
+static void render_clock(void* data)
+{
+    time_t now = time(NULL);
+    char clock_str[8] = "--:--";
+    
+    if (time_is_valid(now)) {
+        struct tm local;
+        localtime_r(&now, &local);
+        snprintf(clock_str, sizeof(clock_str), "%02d:%02d", local.tm_hour, local.tm_min);
+    }
+    
+    char alarm_hour[8] = "--";
+    char alarm_minute[8] = "--";
+    int32_t alarm = s_alarm_minutes;
+    if (alarm != ALARM_NONE) {
+        snprintf(alarm_hour, sizeof(alarm_hour), "%d", (int)(alarm / 60));
+        snprintf(alarm_minute, sizeof(alarm_minute), "%02d", (int)(alarm % 60));
+    }
+    
+    nextion_set_field(NEXTION_FIELD_HOME_CLOCK, clock_str);
+    nextion_set_field(NEXTION_FIELD_HOME_ALARM_HOUR, alarm_hour);
+    nextion_set_field(NEXTION_FIELD_HOME_ALARM_MINUTE, alarm_minute);
+    nextion_render();
+}
+
+static void arm_minute_timer(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    
+    // Fire just after the next wall-clock minute so the display never shows the old minute
+    int64_t delay_us = (60 - tv.tv_sec % 60) * 1000000LL - tv.tv_usec + 50000;
+    esp_timer_stop(s_minute_timer);
+    esp_timer_start_once(s_minute_timer, delay_us);
+}
+
+static void request_render(void)
+{
+    // Timer and SNTP callbacks run in system tasks; UART writes belong to the UI worker
+    if (event_dispatcher_post(EVENT_PRIORITY_UI, render_clock, NULL, 0) != ESP_OK) {
+        ESP_LOGW(TAG, "Clock render dropped");
+    }
+}
+
+static void minute_timer_callback(void* arg)
+{
+    request_render();
+    arm_minute_timer();
+}
+
+static void sntp_sync_callback(struct timeval* tv)
+{
+    s_last_sntp_sync_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "SNTP time synchronized");
+    request_render();
+    arm_minute_timer();
+}
+
+esp_err_t local_clock_init(void)
+{
+    if (s_minute_timer) {
+        return ESP_OK;
+    }
+    
+    setenv("TZ", LOCAL_CLOCK_TZ, 1);
+    tzset();
+    
+    const esp_timer_create_args_t timer_args = {
+        .callback = minute_timer_callback,
+        .name = "clock_tick",
+    };
+    esp_err_t ret = esp_timer_create(&timer_args, &s_minute_timer);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    // lwIP keeps retrying in the background, so this is safe before Wi-Fi is up
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(LOCAL_CLOCK_NTP_SERVER);
+    config.sync_cb = sntp_sync_callback;
+    ret = esp_netif_sntp_init(&config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "SNTP init failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    arm_minute_timer();
+    ESP_LOGI(TAG, "Local clock started (TZ=%s, NTP=%s)", LOCAL_CLOCK_TZ, LOCAL_CLOCK_NTP_SERVER);
+    return ESP_OK;
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date (newlib has no timegm)
+static int64_t days_from_civil(int year, int month, int day)
+{
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static bool parse_iso8601(const char* text, time_t* out)
+{
+    int year, month, day, hour, minute, second;
+    int consumed = 0;
+    
+    if (!text || sscanf(text, "%d-%d-%dT%d:%d:%d%n", &year, &month, &day, &hour, &minute, &second, &consumed) != 6) {
+        return false;
+    }
+    
+    const char* rest = text + consumed;
+    if (*rest == '.') {
+        rest++;
+        while (*rest >= '0' && *rest <= '9') {
+            rest++;
+        }
+    }
+    
+    int offset_s = 0;
+    if (*rest == '+' || *rest == '-') {
+        int off_h, off_m;
+        if (sscanf(rest + 1, "%d:%d", &off_h, &off_m) != 2) {
+            return false;
+        }
+        offset_s = (off_h * 3600 + off_m * 60) * (*rest == '-' ? -1 : 1);
+    } else if (*rest != 'Z') {
+        return false;
+    }
+    
+    *out = (time_t)(days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second - offset_s);
+    return true;
+}
+
+void local_clock_correct_from_server(const char* server_time)
+{
+    time_t server;
+    if (!parse_iso8601(server_time, &server)) {
+        return;
+    }
+    
+    int64_t since_sntp_s = (esp_timer_get_time() - s_last_sntp_sync_us) / 1000000;
+    if (s_last_sntp_sync_us != 0 && since_sntp_s < LOCAL_CLOCK_SNTP_FRESH_S) {
+        return;
+    }
+    
+    time_t now = time(NULL);
+    int64_t drift = (int64_t)server - now;
+    if (llabs(drift) < LOCAL_CLOCK_DRIFT_TOLERANCE_S) {
+        return;
+    }
+    
+    if (!time_is_valid(now) || llabs(drift) >= LOCAL_CLOCK_STEP_THRESHOLD_S) {
+        struct timeval tv = { .tv_sec = server, .tv_usec = 0 };
+        settimeofday(&tv, NULL);
+        ESP_LOGI(TAG, "Clock stepped by %lld s from server time", (long long)drift);
+        request_render();
+        arm_minute_timer();
+    } else {
+        struct timeval delta = { .tv_sec = (time_t)drift, .tv_usec = 0 };
+        adjtime(&delta, NULL);
+        ESP_LOGI(TAG, "Clock slewing %lld s toward server time", (long long)drift);
+    }
+}
+
+void local_clock_set_alarm(const char* next_alarm)
+{
+    int32_t alarm = ALARM_NONE;
+    time_t when;
+    
+    if (next_alarm && next_alarm[0] != '\0' && parse_iso8601(next_alarm, &when)) {
+        struct tm local;
+        localtime_r(&when, &local);
+        alarm = local.tm_hour * 60 + local.tm_min;
+    }
+    
+    if (alarm != s_alarm_minutes) {
+        s_alarm_minutes = alarm;
+        request_render();
+    }
+}
@@ -26,10 +26,10 @@ void app_main(void)
         ESP_LOGI(TAG, "Phase 1: Starting provisioning AP mode");
         provisioning_mode_start(device_id);
     } else {
-        char device_token[512];
-        device_config_get_device_token(device_token);
+        size_t token_len;
+        device_config_device_token_view(&token_len);
         
-        if (strlen(device_token) == 0) {
+        if (token_len == 0) {
             // Phase 2: WiFi connection + Device registration
             ESP_LOGI(TAG, "Phase 2: WiFi connection and device registration");
             phase2_wifi_connect_and_register(device_id);
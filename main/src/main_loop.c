@@ -11,15 +11,30 @@
 #include "home_display.h"
 #include "fota_manager.h"
 #include "nextion_hmi.h"
+#include "local_clock.h"
+#include "install_window.h"
+#include "event_dispatcher.h"
 
 static const char *TAG = "MAIN_LOOP";
 
+#define FOTA_RENDER_RETRY_MS 200
+
+// Latest FOTA status for the UI worker. A post only wakes the worker, which renders whatever
+// is newest, so a full queue delays a COMPLETE/ERROR transition but never loses it.
+static fota_status_t s_fota_status;
+static bool s_fota_render_pending = false;
+static portMUX_TYPE s_fota_status_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_fota_render_retry = NULL;
+
 static void send_heartbeat_if_needed(const char* device_id)
 {
-    char device_token[512];
-    device_config_get_device_token(device_token);
+    // The token view is only read while the request builds its header; a save that overlaps
+    // the request may have torn it, so that result is dropped and the next heartbeat retries
+    uint32_t config_version = device_config_read_begin();
+    size_t token_len;
+    const char* device_token = device_config_device_token_view(&token_len);
     
-    if (strlen(device_token) == 0) {
+    if (token_len == 0) {
         ESP_LOGW(TAG, "No device token available for heartbeat");
         return;
     }
@@ -39,14 +54,22 @@ static void send_heartbeat_if_needed(const char* device_id)
     api_response_t api_response;
     
     esp_err_t ret = api_client_send_heartbeat_v2(device_id, device_token, &heartbeat_data, &response, &api_response);
+    if (device_config_read_retry(config_version)) {
+        ESP_LOGW(TAG, "Device token changed during the heartbeat - result discarded");
+        return;
+    }
     
     if (ret == ESP_OK && api_response.success) {
         ESP_LOGI(TAG, "Heartbeat sent successfully");
         
-        // Update display with response data using detailed formatting
+        // Backend reachable end to end - the running image is healthy
+        fota_mark_running_partition_valid();
+        
+        // Server time only corrects drift; the clock itself is rendered from local time
+        local_clock_correct_from_server(response.server_time);
+        local_clock_set_alarm(response.alarm_info.enabled ? response.alarm_info.next_alarm : NULL);
+        
         nextion_show_heartbeat_data_detailed(
-            response.current_time_kr,
-            response.alarm_info.alarm_time_display,
             heartbeat_data.room_temp,
             heartbeat_data.room_humidity
         );
@@ -57,25 +80,91 @@ static void send_heartbeat_if_needed(const char* device_id)
     }
 }
 
+static void render_fota_progress(void* data)
+{
+    fota_status_t status;
+    
+    portENTER_CRITICAL(&s_fota_status_mux);
+    status = s_fota_status;
+    s_fota_render_pending = false;
+    portEXIT_CRITICAL(&s_fota_status_mux);
+    
+    home_display_render_fota_status(&status);
+}
+
+// Stays pending until the worker runs, so a failed post is retried from the timer
+static void post_fota_render(void* arg)
+{
+    if (event_dispatcher_post(EVENT_PRIORITY_UI, render_fota_progress, NULL, 0) == ESP_OK) {
+        return;
+    }
+    ESP_LOGW(TAG, "FOTA progress render deferred");
+    if (s_fota_render_retry) {
+        esp_timer_start_once(s_fota_render_retry, FOTA_RENDER_RETRY_MS * 1000);
+    }
+}
+
 static void fota_progress_callback(fota_status_t* status)
 {
     ESP_LOGI(TAG, "FOTA Progress: %d%% - State: %d", status->progress_percent, status->state);
     
-    // 진행 상황을 홈 화면에 즉시 업데이트
-    home_display_update();
+    // 진행 상황은 UI 워커에서 화면에만 반영 (다운로드 중 /home 요청 없음)
+    portENTER_CRITICAL(&s_fota_status_mux);
+    s_fota_status = *status;
+    bool post = !s_fota_render_pending;
+    s_fota_render_pending = true;
+    portEXIT_CRITICAL(&s_fota_status_mux);
+    
+    if (post) {
+        post_fota_render(NULL);
+    }
+}
+
+static void tft_upload_progress(uint32_t bytes_acked, uint32_t total_bytes)
+{
+    static uint8_t last_percent = 0;
+    uint8_t percent = (uint8_t)((uint64_t)bytes_acked * 100 / total_bytes);
+    
+    // The panel is in download mode and cannot show anything, so progress goes to the log
+    if (percent / 10 != last_percent / 10 || bytes_acked == total_bytes) {
+        ESP_LOGI(TAG, "Panel UI upload: %d%% (%lu / %lu bytes)", percent,
+                 (unsigned long)bytes_acked, (unsigned long)total_bytes);
+    }
+    last_percent = percent;
+}
+
+static esp_err_t tft_update_handler(const esp_partition_t* partition, uint32_t size)
+{
+    return nextion_tft_upload(partition, size, tft_upload_progress);
+}
+
+static void log_last_swap_timing(void)
+{
+    uint32_t boot_ms, ready_ms;
+    if (fota_get_swap_timing(&boot_ms, &ready_ms) == ESP_OK) {
+        ESP_LOGI(TAG, "Last firmware swap: booted in %lu ms, confirmed after %lu ms",
+                 (unsigned long)boot_ms, (unsigned long)ready_ms);
+    }
 }
 
 static void check_fota_updates(const char* device_id)
 {
-    char token[256];
-    device_config_get_auth_token(token);
+    // Same seqlock bracket as the heartbeat. fota_start_update() reads the token only for its
+    // own re-check, where a torn value just reports no update until the next check.
+    uint32_t config_version = device_config_read_begin();
+    const char* token = device_config_auth_token_view(NULL);
     
     fota_info_t fota_info;
     esp_err_t ret = fota_check_for_updates(device_id, token, &fota_info);
+    if (device_config_read_retry(config_version)) {
+        ESP_LOGW(TAG, "Auth token changed during the FOTA check - skipped");
+        return;
+    }
     
-    if (ret == ESP_OK && fota_info.update_available) {
-        ESP_LOGI(TAG, "FOTA update available: %s -> %s", 
-                fota_info.current_version, fota_info.available_version);
+    if (ret == ESP_OK && (fota_info.update_available || fota_info.subboard_update_available)) {
+        ESP_LOGI(TAG, "FOTA update available: %s -> %s%s", 
+                fota_info.current_version, fota_info.available_version,
+                fota_info.subboard_update_available ? " (+ sub-boards)" : "");
         
         esp_err_t update_ret = fota_start_update(device_id, token);
         if (update_ret == ESP_OK) {
@@ -105,8 +194,25 @@ static void handle_periodic_updates(const char* device_id)
 
 void main_loop_run(const char* device_id)
 {
+    vTaskPrioritySet(NULL, MAIN_LOOP_TASK_PRIORITY);
+    
     // FOTA 진행 상황 콜백 설정
+    const esp_timer_create_args_t retry_args = {
+        .callback = post_fota_render,
+        .name = "fota_render",
+    };
+    if (esp_timer_create(&retry_args, &s_fota_render_retry) != ESP_OK) {
+        ESP_LOGW(TAG, "No FOTA render retry timer");
+    }
     fota_set_progress_callback(fota_progress_callback);
+    fota_set_tft_handler(tft_update_handler);
+    
+    // 자동 업데이트는 백그라운드로: 하트비트/명령 요청 중에는 다운로드 일시 정지
+    fota_set_background_mode(true, FOTA_BACKGROUND_DEFAULT_KBPS);
+    
+    // 다운로드/검증은 언제든, 재부팅은 낮 시간 + 사용 중이 아닐 때만
+    fota_set_install_guard(install_window_is_open);
+    log_last_swap_timing();
     
     while (1) {
         if (wifi_manager_is_connected() && 
@@ -116,6 +222,7 @@ void main_loop_run(const char* device_id)
             
             send_heartbeat_if_needed(device_id);
             handle_periodic_updates(device_id);
+            nextion_latency_log_summary();
         }
         
         vTaskDelay(pdMS_TO_TICKS(HEARTBEAT_INTERVAL_MS));
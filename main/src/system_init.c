@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
@@ -16,9 +17,44 @@
 #include "app_state.h"
 #include "fota_manager.h"
 #include "button_handler.h"
+#include "event_dispatcher.h"
+#include "local_clock.h"
+#include "ts_store.h"
 
 static const char *TAG = "SYSTEM_INIT";
 
+#if CONFIG_SUBBOARD_FOTA
+// ATmega328P: 128-byte pages, 32 KB flash minus the 512-byte Optiboot section
+#define ATMEGA328P_SUBBOARD(board_name, reset) {                 \
+        .name = board_name,                                     \
+        .uart_num = SUBBOARD_UART_NUM,                          \
+        .tx_pin = SUBBOARD_TX_PIN,                              \
+        .rx_pin = SUBBOARD_RX_PIN,                              \
+        .reset_pin = reset,                                     \
+        .baud_rate = SUBBOARD_BAUD_RATE,                        \
+        .page_size = 128,                                       \
+        .max_image_size = 32 * 1024 - 512,                      \
+        .signature = { 0x1e, 0x95, 0x0f },                      \
+    }
+
+static const fota_subboard_t s_subboards[] = {
+    ATMEGA328P_SUBBOARD("sensor", SENSOR_BOARD_RESET_PIN),
+    ATMEGA328P_SUBBOARD("pump", PUMP_BOARD_RESET_PIN),
+};
+
+// A board that cannot be registered is only left out of updates; the device still boots
+static void register_subboards(void)
+{
+    for (size_t i = 0; i < sizeof(s_subboards) / sizeof(s_subboards[0]); i++) {
+        esp_err_t ret = fota_register_subboard(&s_subboards[i]);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Sub-board %s not registered for updates: %s", s_subboards[i].name,
+                     esp_err_to_name(ret));
+        }
+    }
+}
+#endif
+
 esp_err_t system_components_init(void)
 {
     ESP_ERROR_CHECK(nvs_flash_init());
@@ -26,13 +62,23 @@ esp_err_t system_components_init(void)
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     
     ESP_ERROR_CHECK(device_config_init());
+    ESP_ERROR_CHECK(event_dispatcher_init());
     ESP_ERROR_CHECK(nextion_hmi_init());
     ESP_ERROR_CHECK(wifi_manager_init());
+    ESP_ERROR_CHECK(local_clock_init());
     ESP_ERROR_CHECK(web_server_init());
     ESP_ERROR_CHECK(api_client_init());
     ESP_ERROR_CHECK(fota_manager_init());
+#if CONFIG_SUBBOARD_FOTA
+    register_subboards();
+#endif
     ESP_ERROR_CHECK(button_handler_init());
     
+    // Devices updated over the air keep their old partition table; they just run without history
+    if (ts_store_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Sample history disabled");
+    }
+    
     return ESP_OK;
 }
 
@@ -44,7 +90,7 @@ static void button_event_handler(button_event_t event)
             break;
         case BUTTON_EVENT_LONG_PRESS:
             ESP_LOGI(TAG, "BOOT button long press - Factory reset!");
-            nextion_change_page(0);  // Page 0으로 이동
+            nextion_change_page(NEXTION_PAGE_SETUP);  // Page 0으로 이동
             device_config_factory_reset();
             nextion_show_setup_status("Factory reset! Restarting...");
             vTaskDelay(pdMS_TO_TICKS(2000));
@@ -55,12 +101,27 @@ static void button_event_handler(button_event_t event)
     }
 }
 
+static void run_button_event(void* data)
+{
+    button_event_handler(*(button_event_t*)data);
+}
+
+static void button_event_dispatch(button_event_t event)
+{
+    // Long press does NVS erase and restart - keep it off the 2 KB button task
+    event_priority_t priority = (event == BUTTON_EVENT_LONG_PRESS) ?
+                                EVENT_PRIORITY_BACKGROUND : EVENT_PRIORITY_UI;
+    if (event_dispatcher_post(priority, run_button_event, &event, sizeof(event)) != ESP_OK) {
+        ESP_LOGW(TAG, "Button event %d dropped", event);
+    }
+}
+
 void system_callbacks_setup(void)
 {
-    wifi_manager_set_event_callback(wifi_event_handler);
+    wifi_manager_set_event_callback(wifi_event_dispatch);
     web_server_set_callback(wifi_config_handler);
-    nextion_set_event_callback(nextion_event_handler);
-    button_handler_set_callback(button_event_handler);
+    nextion_set_event_callback(nextion_event_dispatch);
+    button_handler_set_callback(button_event_dispatch);
     button_handler_start();
 }
 
@@ -81,7 +142,10 @@ void provisioning_mode_start(const char* device_id)
     char ap_ssid[32];
     generate_ap_credentials(device_id, ap_ssid, ap_password);
     
-    wifi_manager_start_provisioning(ap_ssid, ap_password);
+    // An unprovisioned device has no backend to prove itself against; a working AP is healthy
+    if (wifi_manager_start_provisioning(ap_ssid, ap_password) == ESP_OK) {
+        fota_mark_running_partition_valid();
+    }
     nextion_show_provisioning_info(ap_ssid, ap_password);
     ESP_LOGI(TAG, "Provisioning AP: %s / %s", ap_ssid, ap_password);
 }
@@ -95,7 +159,7 @@ void phase2_wifi_connect_and_register(const char* device_id)
     device_config_get_wifi_credentials(ssid, password);
     wifi_manager_connect_wifi(ssid, password);
     
-    // Device registration will happen in WiFi event handler
+    // Returns immediately; device registration will happen in WiFi event handler
     // After successful registration, it will reboot to Phase 3
 }
 
@@ -111,7 +175,8 @@ void normal_mode_start(void)
     device_config_get_wifi_credentials(ssid, password);
     wifi_manager_connect_wifi_normal_mode(ssid, password);
     
-    // After WiFi connection, go directly to page 1 and start heartbeat
-    nextion_change_page(1);
+    // Association runs in the background; the home page comes up now and the heartbeat starts
+    // once NORMAL_MODE_CONNECTED arrives
+    nextion_change_page(NEXTION_PAGE_HOME);
     app_state_set_home_mode(true);
 }
@@ -0,0 +1,435 @@
+#!/usr/bin/env python3
+"""
+Host-side NEXTION panel simulator.
+
+Speaks the NEXTION serial protocol over a pseudo-terminal (or an existing
+serial port) so nextion_hmi can be exercised and measured without the panel.
+
+  * Parses instructions terminated by FF FF FF: page, <obj>.txt=, <obj>.val=,
+    bkcmd=, baud=, sendme, add, addt and the empty wake-up command
+  * Runs the addt transparent transfer (FE FF FF FF ready, raw bytes, FD FF FF FF done)
+  * Accepts whmi-wris TFT uploads: 0x05 per 4 KB chunk, 0x08 + resume offset after the first
+  * Keeps a per-page component model (page switches reload HMI defaults)
+  * Replays touch / page navigation events from a script
+  * Models wire time at the configured baud rate (10 bits per byte)
+  * Reports bytes per refresh and touch-to-update latency as JSON
+
+Script format (one event per line, '#' comments):
+    at <seconds> touch <page> <component>   # 65 pp cc FF FF FF, as the HMI printh's it
+    at <seconds> page <page>                # user navigation, panel replies 66 pp FF FF FF
+    at <seconds> dump                       # print the component model
+    at <seconds> quit
+
+Usage:
+    nextion_sim.py [--link /tmp/nextion] [--script demo.txt] [--report out.json]
+    nextion_sim.py --port /dev/ttyUSB0      # ESP32 UART1 through a USB-serial adapter
+
+nextion_hmi only builds for the target (ESP-IDF UART driver), so nothing in the
+repo drives the pty on the host; real render/event measurements need the device
+on --port. The pty is for checking scripts and typing commands by hand.
+"""
+
+import argparse
+import json
+import os
+import pty
+import re
+import select
+import sys
+import termios
+import time
+import tty
+
+TERMINATOR = b"\xff\xff\xff"
+
+RET_INVALID_INSTRUCTION = 0x00
+RET_SUCCESS = 0x01
+RET_INVALID_PAGE = 0x03
+EVT_TOUCH = 0x65
+EVT_CURRENT_PAGE = 0x66
+RET_TRANSPARENT_DONE = 0xFD
+RET_TRANSPARENT_READY = 0xFE
+
+TXT_RE = re.compile(r'^(\w+)\.txt="(.*)"$', re.S)
+VAL_RE = re.compile(r'^(\w+)\.val=(-?\d+)$')
+ASSIGN_RE = re.compile(r'^(bkcmd|baud|bauds)=(\d+)$')
+ADD_RE = re.compile(r'^add (\d+),(\d+),(\d+)$')
+ADDT_RE = re.compile(r'^addt (\d+),(\d+),(\d+)$')
+WRIS_RE = re.compile(r'^whmi-wris? (\d+),(\d+),(\d+)$')
+TFT_CHUNK = 4096
+TFT_ACK = 0x05
+TFT_SKIP = 0x08
+
+
+class Panel:
+    def __init__(self, pages, baud, refresh_gap, verbose, tft_resume=0):
+        self.pages = pages
+        self.page = 0
+        self.components = {p: {} for p in range(pages)}
+        self.bkcmd = 2
+        self.baud = baud
+        self.refresh_gap = refresh_gap
+        self.verbose = verbose
+
+        self.rx = bytearray()
+        self.wire_free_at = 0.0
+        self.total_bytes = 0
+        self.commands = 0
+        self.unknown = 0
+        self.refreshes = []
+        self.current_refresh = None
+        self.last_command_at = None
+        self.pending_touch = None
+        self.touch_latencies = []
+
+        self.transparent = None
+        self.waveforms = {}
+        self.waveform_bytes = 0
+
+        self.tft_resume = tft_resume
+        self.download = None
+        self.tft_uploads = []
+
+    # Wire model: a command is on the panel only after its bytes have been clocked in
+    def _wire_time(self, nbytes):
+        return nbytes * 10.0 / self.baud
+
+    def feed(self, data, now):
+        self.rx.extend(data)
+        replies = bytearray()
+        while True:
+            if self.download:
+                replies.extend(self._feed_download(now))
+                if self.download:
+                    break
+                continue
+            if self.transparent:
+                replies.extend(self._feed_transparent(now))
+                if self.transparent:
+                    break
+                continue
+            end = self.rx.find(TERMINATOR)
+            if end < 0:
+                break
+            raw = bytes(self.rx[:end])
+            del self.rx[:end + len(TERMINATOR)]
+            size = len(raw) + len(TERMINATOR)
+            self.wire_free_at = max(self.wire_free_at, now) + self._wire_time(size)
+            self._account(size, self.wire_free_at)
+            if raw.startswith((b"add ", b"addt ")):
+                self.waveform_bytes += size
+            replies.extend(self.execute(raw))
+        return bytes(replies)
+
+    # Raw addt payload: exactly `remaining` bytes, no terminator, FF is ordinary data
+    def _feed_transparent(self, now):
+        take = min(self.transparent["remaining"], len(self.rx))
+        if take == 0:
+            return b""
+        chunk = bytes(self.rx[:take])
+        del self.rx[:take]
+        self.wire_free_at = max(self.wire_free_at, now) + self._wire_time(take)
+        self.total_bytes += take
+        self.waveform_bytes += take
+        if self.current_refresh is not None:
+            self.current_refresh["bytes"] += take
+            self.current_refresh["end"] = self.wire_free_at
+        self.last_command_at = self.wire_free_at
+
+        self._plot(self.transparent["key"], chunk)
+        self.transparent["remaining"] -= take
+        if self.transparent["remaining"] > 0:
+            return b""
+        self._log(f"addt {self.transparent['key']} done")
+        self.transparent = None
+        return bytes([RET_TRANSPARENT_DONE]) + TERMINATOR
+
+    # whmi-wris download: raw file bytes acknowledged per chunk, at the upload baud
+    def _feed_download(self, now):
+        dl = self.download
+        take = min(dl["chunk_left"], len(self.rx))
+        if take == 0:
+            return b""
+        del self.rx[:take]
+        self.wire_free_at = max(self.wire_free_at, now) + self._wire_time(take)
+        self.total_bytes += take
+        dl["received"] += take
+        dl["offset"] += take
+        dl["chunk_left"] -= take
+        if dl["chunk_left"] > 0:
+            return b""
+
+        reply = bytes([TFT_ACK])
+        if dl["first"]:
+            dl["first"] = False
+            resume = self.tft_resume if 0 < self.tft_resume < dl["size"] else 0
+            reply = bytes([TFT_SKIP]) + resume.to_bytes(4, "little")
+            if resume:
+                dl["offset"] = resume
+        dl["chunk_left"] = min(TFT_CHUNK, dl["size"] - dl["offset"])
+        if dl["chunk_left"] == 0:
+            dl["end"] = self.wire_free_at
+            self.tft_uploads.append({
+                "size": dl["size"], "received": dl["received"], "baud": self.baud,
+                "seconds": round(dl["end"] - dl["start"], 3),
+            })
+            self._log(f"tft upload done: {dl['received']} of {dl['size']} bytes")
+            self.download = None
+            # The panel reboots into the new UI at its default rate
+            self.baud = dl["restore_baud"]
+            self.show_page(0)
+        return reply
+
+    def _plot(self, key, values):
+        wave = self.waveforms.setdefault(key, {"points": 0, "last": None})
+        wave["points"] += len(values)
+        wave["last"] = values[-1]
+
+    def _account(self, size, done_at):
+        self.total_bytes += size
+        self.commands += 1
+
+        if self.last_command_at is None or done_at - self.last_command_at > self.refresh_gap:
+            self.current_refresh = {"start": done_at - self._wire_time(size), "bytes": 0, "commands": 0}
+            self.refreshes.append(self.current_refresh)
+        self.current_refresh["bytes"] += size
+        self.current_refresh["commands"] += 1
+        self.current_refresh["end"] = done_at
+        self.last_command_at = done_at
+
+        if self.pending_touch is not None:
+            self.touch_latencies.append(done_at - self.pending_touch)
+            self.pending_touch = None
+
+    def _ack(self, code):
+        if code == RET_SUCCESS and self.bkcmd in (1, 3):
+            return bytes([code]) + TERMINATOR
+        if code != RET_SUCCESS and self.bkcmd in (2, 3):
+            return bytes([code]) + TERMINATOR
+        return b""
+
+    def _log(self, msg):
+        if self.verbose:
+            print(f"[panel] {msg}", file=sys.stderr)
+
+    def show_page(self, page):
+        self.page = page
+        self.components[page] = {}
+
+    def execute(self, raw):
+        try:
+            cmd = raw.decode("utf-8")
+        except UnicodeDecodeError:
+            cmd = raw.decode("latin-1")
+
+        if cmd == "":
+            return b""
+        if cmd.startswith("page "):
+            try:
+                page = int(cmd[5:])
+            except ValueError:
+                return self._ack(RET_INVALID_PAGE)
+            if not 0 <= page < self.pages:
+                return self._ack(RET_INVALID_PAGE)
+            self.show_page(page)
+            self._log(f"page {page}")
+            return self._ack(RET_SUCCESS)
+        if cmd == "sendme":
+            return bytes([EVT_CURRENT_PAGE, self.page]) + TERMINATOR
+
+        m = TXT_RE.match(cmd)
+        if m:
+            self.components[self.page][m.group(1)] = m.group(2)
+            self._log(f"p{self.page}.{m.group(1)}.txt = {m.group(2)!r}")
+            return self._ack(RET_SUCCESS)
+        m = VAL_RE.match(cmd)
+        if m:
+            self.components[self.page][m.group(1)] = int(m.group(2))
+            return self._ack(RET_SUCCESS)
+        m = ADD_RE.match(cmd)
+        if m:
+            self._plot(f"{m.group(1)}.{m.group(2)}", bytes([int(m.group(3)) & 0xFF]))
+            return self._ack(RET_SUCCESS)
+        m = ADDT_RE.match(cmd)
+        if m:
+            count = int(m.group(3))
+            if count == 0:
+                return self._ack(RET_SUCCESS)
+            self.transparent = {"key": f"{m.group(1)}.{m.group(2)}", "remaining": count}
+            return bytes([RET_TRANSPARENT_READY]) + TERMINATOR
+        m = WRIS_RE.match(cmd)
+        if m:
+            size, baud = int(m.group(1)), int(m.group(2))
+            self._log(f"tft upload of {size} bytes at {baud} baud")
+            self.download = {
+                "size": size, "offset": 0, "received": 0, "first": True,
+                "chunk_left": min(TFT_CHUNK, size), "start": self.wire_free_at,
+                "restore_baud": self.baud,
+            }
+            self.baud = baud
+            return bytes([TFT_ACK])
+        m = ASSIGN_RE.match(cmd)
+        if m:
+            key, value = m.group(1), int(m.group(2))
+            if key == "bkcmd":
+                self.bkcmd = value
+                return b""
+            self.baud = value
+            self._log(f"baud -> {value}")
+            return self._ack(RET_SUCCESS)
+
+        self.unknown += 1
+        self._log(f"unknown instruction {cmd!r}")
+        return self._ack(RET_INVALID_INSTRUCTION)
+
+    def touch(self, page, component, now):
+        if page != self.page:
+            self.show_page(page)
+        self.pending_touch = now
+        return bytes([EVT_TOUCH, page, component]) + TERMINATOR
+
+    def navigate(self, page):
+        self.show_page(page)
+        return bytes([EVT_CURRENT_PAGE, page]) + TERMINATOR
+
+    def report(self):
+        per_refresh = [r["bytes"] for r in self.refreshes]
+        latencies = sorted(self.touch_latencies)
+
+        def pct(values, q):
+            if not values:
+                return None
+            return values[min(len(values) - 1, int(q * len(values)))]
+
+        return {
+            "baud": self.baud,
+            "total_bytes": self.total_bytes,
+            "commands": self.commands,
+            "unknown_commands": self.unknown,
+            "refreshes": len(per_refresh),
+            "bytes_per_refresh_avg": (sum(per_refresh) / len(per_refresh)) if per_refresh else 0,
+            "bytes_per_refresh_max": max(per_refresh) if per_refresh else 0,
+            "wire_ms_per_refresh_max": max(((r["end"] - r["start"]) * 1000 for r in self.refreshes), default=0),
+            "touch_to_update_ms_p50": pct([v * 1000 for v in latencies], 0.5),
+            "touch_to_update_ms_p90": pct([v * 1000 for v in latencies], 0.9),
+            "waveform_bytes": self.waveform_bytes,
+            "waveform_share": (self.waveform_bytes / self.total_bytes) if self.total_bytes else 0,
+            "waveforms": self.waveforms,
+            "tft_uploads": self.tft_uploads,
+            "page": self.page,
+            "components": {str(p): c for p, c in self.components.items() if c},
+        }
+
+
+def load_script(path):
+    events = []
+    if not path:
+        return events
+    with open(path, encoding="utf-8") as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            parts = line.split()
+            if len(parts) < 3 or parts[0] != "at":
+                raise SystemExit(f"{path}:{lineno}: expected 'at <seconds> <event> ...'")
+            events.append((float(parts[1]), parts[2], [int(a) for a in parts[3:]]))
+    events.sort(key=lambda e: e[0])
+    return events
+
+
+def open_link(args):
+    if args.port:
+        fd = os.open(args.port, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(fd)
+        return fd, args.port
+
+    master, slave = pty.openpty()
+    tty.setraw(slave)
+    attrs = termios.tcgetattr(slave)
+    attrs[3] &= ~termios.ECHO
+    termios.tcsetattr(slave, termios.TCSANOW, attrs)
+    name = os.ttyname(slave)
+    if args.link:
+        if os.path.islink(args.link):
+            os.unlink(args.link)
+        os.symlink(name, args.link)
+        name = f"{args.link} -> {name}"
+    return master, name
+
+
+def main():
+    parser = argparse.ArgumentParser(description="NEXTION panel simulator")
+    parser.add_argument("--port", help="use an existing serial device instead of a pty")
+    parser.add_argument("--link", help="symlink the pty slave to this path")
+    parser.add_argument("--baud", type=int, default=9600, help="modelled wire rate (default 9600)")
+    parser.add_argument("--pages", type=int, default=2)
+    parser.add_argument("--script", help="touch/page event script")
+    parser.add_argument("--duration", type=float, default=0, help="stop after N seconds (0 = until quit)")
+    parser.add_argument("--refresh-gap", type=float, default=0.2,
+                        help="idle seconds that separate two refreshes (default 0.2)")
+    parser.add_argument("--report", help="write the JSON report here instead of stdout")
+    parser.add_argument("--tft-resume", type=int, default=0,
+                        help="pretend the panel already holds this many bytes of the next TFT upload")
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+
+    panel = Panel(args.pages, args.baud, args.refresh_gap, args.verbose, args.tft_resume)
+    events = load_script(args.script)
+    fd, name = open_link(args)
+    print(f"NEXTION simulator on {name} ({args.baud} baud)", file=sys.stderr)
+
+    start = time.monotonic()
+    try:
+        while True:
+            now = time.monotonic()
+            elapsed = now - start
+            if args.duration and elapsed >= args.duration:
+                break
+
+            while events and events[0][0] <= elapsed:
+                _, kind, params = events.pop(0)
+                if kind == "touch":
+                    os.write(fd, panel.touch(params[0], params[1], now))
+                elif kind == "page":
+                    os.write(fd, panel.navigate(params[0]))
+                elif kind == "dump":
+                    print(json.dumps(panel.components, ensure_ascii=False), file=sys.stderr)
+                elif kind == "quit":
+                    raise KeyboardInterrupt
+                else:
+                    raise SystemExit(f"unknown script event '{kind}'")
+
+            timeout = 0.05
+            if events:
+                timeout = max(0.0, min(timeout, events[0][0] - elapsed))
+            readable, _, _ = select.select([fd], [], [], timeout)
+            if readable:
+                try:
+                    data = os.read(fd, 4096)
+                except OSError:
+                    data = b""
+                if data:
+                    replies = panel.feed(data, time.monotonic())
+                    if replies:
+                        # Replies leave only once the instruction has crossed the wire
+                        delay = panel.wire_free_at - time.monotonic()
+                        if delay > 0:
+                            time.sleep(delay)
+                        os.write(fd, replies)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if args.link and not args.port and os.path.islink(args.link):
+            os.unlink(args.link)
+
+    report = json.dumps(panel.report(), indent=2, ensure_ascii=False)
+    if args.report:
+        with open(args.report, "w", encoding="utf-8") as f:
+            f.write(report + "\n")
+    else:
+        print(report)
+
+
+if __name__ == "__main__":
+    main()
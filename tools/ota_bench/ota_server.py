@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""
+Local HTTPS stand-in for the firmware download server.
+
+Serves an application image to fota_manager so OTA throughput can be measured on
+the bench instead of against the production CDN.
+
+  * GET /firmware.bin        the image as-is (Content-Length, Range -> 206)
+  * GET /firmware.bin.zlib   the same image zlib-compressed (manifest "compression")
+  * GET /manifest.json       firmware-check style manifest for the image above
+  * Optional link shaping (--rate KB/s) and a forced disconnect (--drop-at BYTES)
+    to exercise resume
+  * Reports bytes, duration and KB/s for every transfer, optionally as JSON
+
+The device validates the server against the certificate bundle. For bench builds add
+the generated certificate with CONFIG_MBEDTLS_CUSTOM_CERTIFICATE_BUNDLE_PATH, or pass
+--cert/--key for a certificate the device already trusts.
+
+Usage:
+    ota_server.py build/baegaepro-firmware.bin [--host 0.0.0.0] [--port 8443]
+                  [--version 1.0.1] [--rate 200] [--drop-at 300000] [--report ota_bench.json]
+"""
+
+import argparse
+import hashlib
+import http.server
+import json
+import os
+import re
+import signal
+import socket
+import ssl
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import zlib
+
+RANGE_RE = re.compile(r'^bytes=(\d+)-(\d*)$')
+SEND_CHUNK = 4096
+
+
+class Bench:
+    def __init__(self, image, version, rate_kbps, drop_at):
+        self.image = image
+        self.image_zlib = zlib.compress(image, 9)
+        self.version = version
+        self.rate = rate_kbps * 1024 if rate_kbps else 0
+        self.drop_at = drop_at
+        self.dropped = False
+        self.transfers = []
+        self.lock = threading.Lock()
+
+    def manifest(self, base_url):
+        return {
+            "version": self.version,
+            "download_url": base_url + "/firmware.bin",
+            "sha256": hashlib.sha256(self.image).hexdigest(),
+            "file_size": len(self.image),
+            "compressed_size": len(self.image_zlib),
+        }
+
+    def record(self, entry):
+        with self.lock:
+            self.transfers.append(entry)
+        print("{path} {status} offset={offset} bytes={bytes} {ms} ms {kbps:.1f} KB/s{note}".format(
+            note=" (dropped)" if entry["dropped"] else "", **entry), flush=True)
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    bench = None
+    base_url = ""
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def do_GET(self):
+        if self.path == "/manifest.json":
+            body = json.dumps(self.bench.manifest(self.base_url), indent=2).encode()
+            self.send_response(200)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+            return
+
+        if self.path == "/firmware.bin":
+            data = self.bench.image
+        elif self.path == "/firmware.bin.zlib":
+            data = self.bench.image_zlib
+        else:
+            self.send_error(404)
+            return
+
+        start, end, status = 0, len(data) - 1, 200
+        match = RANGE_RE.match(self.headers.get("Range", ""))
+        if match:
+            start = int(match.group(1))
+            end = int(match.group(2)) if match.group(2) else end
+            if start >= len(data) or end < start:
+                self.send_error(416)
+                return
+            status = 206
+
+        self.send_response(status)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(end - start + 1))
+        if status == 206:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end, len(data)))
+        self.end_headers()
+        self.stream(data, start, end + 1, status)
+
+    def stream(self, data, start, stop, status):
+        sent = 0
+        dropped = False
+        t0 = time.monotonic()
+        pos = start
+        try:
+            while pos < stop:
+                chunk = data[pos:min(pos + SEND_CHUNK, stop)]
+                if self.bench.drop_at and not self.bench.dropped and pos + len(chunk) > self.bench.drop_at:
+                    self.bench.dropped = True
+                    dropped = True
+                    self.connection.shutdown(socket.SHUT_RDWR)
+                    break
+                self.wfile.write(chunk)
+                pos += len(chunk)
+                sent += len(chunk)
+                if self.bench.rate:
+                    # Pace against the start time so the average, not each chunk, meets the cap
+                    ahead = sent / self.bench.rate - (time.monotonic() - t0)
+                    if ahead > 0:
+                        time.sleep(ahead)
+            self.wfile.flush()
+        except (BrokenPipeError, ConnectionResetError, ssl.SSLError):
+            dropped = True
+        elapsed = time.monotonic() - t0
+        self.bench.record({
+            "path": self.path,
+            "status": status,
+            "offset": start,
+            "bytes": sent,
+            "ms": int(elapsed * 1000),
+            "kbps": sent / 1024 / elapsed if elapsed > 0 else 0.0,
+            "dropped": dropped,
+        })
+        if dropped:
+            self.close_connection = True
+
+
+def self_signed_cert(host):
+    directory = tempfile.mkdtemp(prefix="ota_bench_")
+    cert = os.path.join(directory, "cert.pem")
+    key = os.path.join(directory, "key.pem")
+    subprocess.run(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "30",
+                    "-subj", "/CN=" + host, "-addext", "subjectAltName=IP:" + host,
+                    "-keyout", key, "-out", cert], check=True, capture_output=True)
+    return cert, key
+
+
+def interrupt(signum, frame):
+    raise KeyboardInterrupt
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Local HTTPS firmware server for OTA throughput tests")
+    parser.add_argument("image", help="application .bin to serve")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--advertise", help="address the device uses to reach this host (manifest URLs)")
+    parser.add_argument("--port", type=int, default=8443)
+    parser.add_argument("--version", default="9.9.9", help="version reported in the manifest")
+    parser.add_argument("--cert")
+    parser.add_argument("--key")
+    parser.add_argument("--rate", type=float, default=0, help="cap per transfer in KB/s (0 = link rate)")
+    parser.add_argument("--drop-at", type=int, default=0, help="disconnect the first transfer at this offset")
+    parser.add_argument("--report", help="write transfer results as JSON on exit")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    advertise = args.advertise or ("127.0.0.1" if args.host == "0.0.0.0" else args.host)
+    cert, key = (args.cert, args.key) if args.cert else self_signed_cert(advertise)
+
+    Handler.bench = Bench(image, args.version, args.rate, args.drop_at)
+    Handler.base_url = "https://%s:%d" % (advertise, args.port)
+
+    server = http.server.ThreadingHTTPServer((args.host, args.port), Handler)
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(cert, key)
+    server.socket = context.wrap_socket(server.socket, server_side=True)
+
+    print("Serving %d byte image (%d zlib) on %s" % (len(image), len(Handler.bench.image_zlib), Handler.base_url))
+    print("Certificate: %s" % cert)
+    print(json.dumps(Handler.bench.manifest(Handler.base_url), indent=2), flush=True)
+
+    signal.signal(signal.SIGTERM, interrupt)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.server_close()
+        if args.report:
+            with open(args.report, "w") as f:
+                json.dump({"image_size": len(image), "transfers": Handler.bench.transfers}, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())